@@ -0,0 +1,143 @@
+#ifndef BINDLESS_TEXTURES_H
+#define BINDLESS_TEXTURES_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "stb_image.h"
+
+// Textures used through ARB_bindless_texture: each one is made resident once and gets a 64 bit
+// handle, the handles live in a shader storage buffer and shaders turn them into samplers with
+// sampler2D(textureHandles[index]). Draws pick a texture by index like they pick a layer of a
+// TextureArray, but nothing is ever bound to a texture unit and the textures can all have
+// different sizes and formats.
+//
+// glad was generated without extensions, so the functions are looked up with
+// glfwGetProcAddress when glfwExtensionSupported finds the extension. Without it isSupported is
+// false and everything here does nothing, use a TextureArray then.
+//
+// A texture's parameters can't be changed once it has a handle, set them before add.
+class BindlessTextures
+{
+public:
+    // shader storage binding of TextureHandles in FragmentShader.txt
+    static const unsigned int handleBinding = 5;
+
+    // ------------------------------------------------------------------------
+    explicit BindlessTextures(size_t capacity = 256)
+        : capacity(capacity)
+    {
+        if (glfwExtensionSupported("GL_ARB_bindless_texture"))
+        {
+            getTextureHandle = reinterpret_cast<GetTextureHandle>(glfwGetProcAddress("glGetTextureHandleARB"));
+            makeResident = reinterpret_cast<MakeTextureHandleResident>(glfwGetProcAddress("glMakeTextureHandleResidentARB"));
+            makeNonResident = reinterpret_cast<MakeTextureHandleResident>(glfwGetProcAddress("glMakeTextureHandleNonResidentARB"));
+        }
+        supported = getTextureHandle && makeResident && makeNonResident;
+        if (!supported)
+            return;
+
+        glCreateBuffers(1, &handleBuffer);
+        glNamedBufferStorage(handleBuffer, capacity * sizeof(uint64_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    }
+
+    ~BindlessTextures()
+    {
+        for (uint64_t handle : handles)
+            makeNonResident(handle);
+        if (!owned.empty())
+            glDeleteTextures(static_cast<GLsizei>(owned.size()), owned.data());
+        if (handleBuffer)
+            glDeleteBuffers(1, &handleBuffer);
+    }
+
+    BindlessTextures(const BindlessTextures&) = delete;
+    BindlessTextures& operator=(const BindlessTextures&) = delete;
+
+    bool isSupported() const { return supported; }
+
+    // Makes a texture resident and returns the index shaders find its handle at, -1 when that
+    // isn't possible. The texture has to stay alive as long as this does
+    // ------------------------------------------------------------------------
+    int add(unsigned int texture)
+    {
+        if (!supported)
+            return -1;
+        if (handles.size() == capacity)
+        {
+            std::cout << "ERROR::BINDLESS_TEXTURES::FULL: room for " << capacity << std::endl;
+            return -1;
+        }
+        uint64_t handle = getTextureHandle(texture);
+        if (handle == 0)
+        {
+            std::cout << "ERROR::BINDLESS_TEXTURES::NO_HANDLE: texture " << texture << std::endl;
+            return -1;
+        }
+        makeResident(handle);
+        int index = static_cast<int>(handles.size());
+        handles.push_back(handle);
+        glNamedBufferSubData(handleBuffer, index * sizeof(uint64_t), sizeof(uint64_t), &handle);
+        return index;
+    }
+
+    // loads an image file with stb_image into a new RGBA8 texture with mipmaps and adds it
+    // ------------------------------------------------------------------------
+    int load(const char* path, GLenum wrap = GL_REPEAT, GLenum minFilter = GL_LINEAR_MIPMAP_LINEAR, GLenum magFilter = GL_LINEAR)
+    {
+        if (!supported)
+            return -1;
+        int width, height, channels;
+        unsigned char* data = stbi_load(path, &width, &height, &channels, 4);
+        if (!data)
+        {
+            std::cout << "ERROR::BINDLESS_TEXTURES::FILE_NOT_LOADED: " << path << std::endl;
+            return -1;
+        }
+        int levels = 1;
+        while ((std::max(width, height) >> levels) > 0)
+            levels++;
+
+        unsigned int texture;
+        glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+        glTextureStorage2D(texture, levels, GL_RGBA8, width, height);
+        glTextureSubImage2D(texture, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        stbi_image_free(data);
+        glGenerateTextureMipmap(texture);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_S, wrap);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_T, wrap);
+        glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, minFilter);
+        glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, magFilter);
+        owned.push_back(texture);
+        return add(texture);
+    }
+
+    // The handles stay bound at handleBinding, so this is needed once and not for every draw
+    void bind() const
+    {
+        if (supported)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, handleBinding, handleBuffer);
+    }
+
+    size_t size() const { return handles.size(); }
+
+private:
+    typedef uint64_t (APIENTRYP GetTextureHandle)(GLuint texture);
+    typedef void (APIENTRYP MakeTextureHandleResident)(uint64_t handle);
+
+    size_t capacity;
+    bool supported = false;
+    GetTextureHandle getTextureHandle = nullptr;
+    MakeTextureHandleResident makeResident = nullptr;
+    MakeTextureHandleResident makeNonResident = nullptr;
+    unsigned int handleBuffer = 0;
+    std::vector<uint64_t> handles;
+    std::vector<unsigned int> owned;
+};
+
+#endif
@@ -0,0 +1,799 @@
+#ifndef BOUNDING_VOLUME_HIERARCHY_H
+#define BOUNDING_VOLUME_HIERARCHY_H
+
+#include "FrustumCulling.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Axis aligned box as its corners
+struct Aabb
+{
+    float min[3];
+    float max[3];
+
+    static Aabb fromCenter(float x, float y, float z, float halfX, float halfY, float halfZ)
+    {
+        Aabb box = { { x - halfX, y - halfY, z - halfZ }, { x + halfX, y + halfY, z + halfZ } };
+        return box;
+    }
+
+    static Aabb merge(const Aabb& a, const Aabb& b)
+    {
+        Aabb box;
+        for (int k = 0; k < 3; k++)
+        {
+            box.min[k] = std::min(a.min[k], b.min[k]);
+            box.max[k] = std::max(a.max[k], b.max[k]);
+        }
+        return box;
+    }
+
+    bool contains(const Aabb& other) const
+    {
+        for (int k = 0; k < 3; k++)
+            if (other.min[k] < min[k] || other.max[k] > max[k])
+                return false;
+        return true;
+    }
+
+    bool overlaps(const Aabb& other) const
+    {
+        for (int k = 0; k < 3; k++)
+            if (other.max[k] < min[k] || other.min[k] > max[k])
+                return false;
+        return true;
+    }
+
+    // half the surface area, what the surface area heuristic compares
+    float area() const
+    {
+        float x = max[0] - min[0], y = max[1] - min[1], z = max[2] - min[2];
+        return x * y + y * z + z * x;
+    }
+
+    Aabb grown(float margin) const
+    {
+        Aabb box = *this;
+        for (int k = 0; k < 3; k++)
+        {
+            box.min[k] -= margin;
+            box.max[k] += margin;
+        }
+        return box;
+    }
+};
+
+struct RayHit
+{
+    uint32_t object = 0;
+    float distance = FLT_MAX;
+    bool hit = false;
+};
+
+// Dynamic bounding volume hierarchy over objects that move, appear and disappear.
+//
+// Every object gets a proxy, a leaf holding its box grown by a margin, so small movements
+// don't touch the tree at all. Moving out of the grown box removes the leaf and inserts it
+// again where it adds the least area (the branch and bound search from Box2D's dynamic tree).
+// Incremental inserts slowly make the tree worse, so maintain() rebuilds it from scratch with a
+// binned surface area heuristic on the job system when its cost has grown enough, and swaps the
+// new tree in on a later call. Changes made while the rebuild runs are replayed on top of it.
+//
+// Queries: frustum culling (a subtree fully inside the frustum is taken without testing its
+// leaves), rays for picking, and boxes or spheres for anything near a point.
+class DynamicBvh
+{
+public:
+    // ------------------------------------------------------------------------
+    explicit DynamicBvh(float margin = 0.1f, JobSystem& jobs = JobSystem::shared())
+        : margin(margin), jobs(jobs)
+    {
+    }
+
+    // returns the proxy of the object, what move and remove take
+    // ------------------------------------------------------------------------
+    int insert(const Aabb& box, uint32_t object)
+    {
+        int proxy;
+        if (freeProxies.empty())
+        {
+            proxy = static_cast<int>(proxies.size());
+            proxies.push_back(Proxy());
+        }
+        else
+        {
+            proxy = freeProxies.back();
+            freeProxies.pop_back();
+        }
+        Proxy& p = proxies[proxy];
+        p.box = box.grown(margin);
+        p.object = object;
+        p.alive = true;
+        p.leaf = insertLeaf(proxy);
+        changed(proxy);
+        return proxy;
+    }
+
+    void remove(int proxy)
+    {
+        removeLeaf(proxies[proxy].leaf);
+        proxies[proxy].leaf = -1;
+        proxies[proxy].alive = false;
+        freeProxies.push_back(proxy);
+        changed(proxy);
+    }
+
+    // Gives the proxy its new box, returns true when the tree had to change. displacement, the
+    // distance moved since the last call, stretches the grown box in that direction so objects
+    // moving steadily leave it less often
+    // ------------------------------------------------------------------------
+    bool move(int proxy, const Aabb& box, const float* displacement = nullptr)
+    {
+        Proxy& p = proxies[proxy];
+        if (p.box.contains(box))
+            return false;
+        removeLeaf(p.leaf);
+        p.box = box.grown(margin);
+        if (displacement)
+            for (int k = 0; k < 3; k++)
+                (displacement[k] < 0.0f ? p.box.min[k] : p.box.max[k]) += 2.0f * displacement[k];
+        p.leaf = insertLeaf(proxy);
+        changed(proxy);
+        return true;
+    }
+
+    // Sets the box without restructuring, for many objects that moved a little when a refit
+    // after all of them is cheaper than moving each. The tree gets worse as boxes drift apart
+    // from their neighbours until the next rebuild.
+    // ------------------------------------------------------------------------
+    void setBounds(int proxy, const Aabb& box)
+    {
+        Proxy& p = proxies[proxy];
+        p.box = box.grown(margin);
+        nodes[p.leaf].box = p.box;
+        refitLeaves.push_back(p.leaf);
+        changed(proxy);
+    }
+
+    // recomputes the boxes above every leaf given to setBounds since the last refit
+    // ------------------------------------------------------------------------
+    void refit()
+    {
+        for (int leaf : refitLeaves)
+        {
+            for (int node = nodes[leaf].parent; node >= 0; node = nodes[node].parent)
+            {
+                Aabb box = Aabb::merge(nodes[nodes[node].left].box, nodes[nodes[node].right].box);
+                if (std::equal(box.min, box.max + 3, nodes[node].box.min))
+                    break;
+                nodes[node].box = box;
+            }
+        }
+        refitLeaves.clear();
+    }
+
+    // Adopts a finished rebuild and starts a new one when the tree's cost has grown by
+    // rebuildFactor since the last, call once a frame after the objects moved
+    // ------------------------------------------------------------------------
+    void maintain(float rebuildFactor = 1.3f)
+    {
+        refit();
+        if (rebuild && rebuild->done)
+            adoptRebuild();
+        if (!rebuild && root >= 0 && cost() > rebuildFactor * builtCost)
+            startRebuild();
+    }
+
+    // builds the tree again from scratch on this thread
+    // ------------------------------------------------------------------------
+    void rebuildNow()
+    {
+        refit();
+        if (rebuild)
+        {
+            // the running one is left to finish and ignored
+            rebuild.reset();
+            for (Proxy& p : proxies)
+                p.changed = false;
+            changedProxies.clear();
+        }
+        std::vector<BuildLeaf> leaves = collectLeaves();
+        std::vector<Node> built;
+        int builtRoot = build(leaves, built);
+        nodes.swap(built);
+        root = builtRoot;
+        freeNodes.clear();
+        relink();
+        builtCost = cost();
+    }
+
+    // Surface area heuristic cost: the summed areas of the internal nodes relative to the root,
+    // about how many boxes a random ray through the scene tests
+    // ------------------------------------------------------------------------
+    float cost() const
+    {
+        if (root < 0 || nodes[root].left < 0)
+            return 0.0f;
+        float total = 0.0f;
+        for (size_t i = 0; i < nodes.size(); i++)
+            if (nodes[i].left >= 0 && nodes[i].parent != freeMarker)
+                total += nodes[i].box.area();
+        return total / std::max(nodes[root].box.area(), FLT_MIN);
+    }
+
+    // calls visit(object) for every object whose box is at least partly inside the frustum
+    // ------------------------------------------------------------------------
+    template <typename Visit>
+    void cull(const Frustum& frustum, const Visit& visit) const
+    {
+        if (root < 0)
+            return;
+        // planes a node is fully inside of are skipped for all of its children
+        struct Entry
+        {
+            int node;
+            unsigned int planes;
+        };
+        std::vector<Entry> stack(1, Entry{ root, 0x3Fu });
+        while (!stack.empty())
+        {
+            Entry entry = stack.back();
+            stack.pop_back();
+            const Node& node = nodes[entry.node];
+            unsigned int planes = entry.planes;
+            bool outside = false;
+            for (int i = 0; i < 6 && !outside; i++)
+            {
+                if (!(planes & (1u << i)))
+                    continue;
+                switch (classify(frustum.planes[i], node.box))
+                {
+                case -1: outside = true; break;
+                case 1: planes &= ~(1u << i); break;
+                default: break;
+                }
+            }
+            if (outside)
+                continue;
+            if (planes == 0)
+            {
+                visitAll(entry.node, visit);
+                continue;
+            }
+            if (node.left < 0)
+            {
+                visit(proxies[node.proxy].object);
+                continue;
+            }
+            stack.push_back(Entry{ node.left, planes });
+            stack.push_back(Entry{ node.right, planes });
+        }
+    }
+
+    // calls visit(object) for every object whose box overlaps box
+    // ------------------------------------------------------------------------
+    template <typename Visit>
+    void query(const Aabb& box, const Visit& visit) const
+    {
+        traverse([&](const Aabb& nodeBox) { return nodeBox.overlaps(box); }, visit);
+    }
+
+    // calls visit(object) for every object whose box comes within radius of center
+    // ------------------------------------------------------------------------
+    template <typename Visit>
+    void query(const float* center, float radius, const Visit& visit) const
+    {
+        float radiusSquared = radius * radius;
+        traverse([&](const Aabb& nodeBox)
+        {
+            float distanceSquared = 0.0f;
+            for (int k = 0; k < 3; k++)
+            {
+                float d = std::max(std::max(nodeBox.min[k] - center[k], center[k] - nodeBox.max[k]), 0.0f);
+                distanceSquared += d * d;
+            }
+            return distanceSquared <= radiusSquared;
+        }, visit);
+    }
+
+    // Closest object along the ray. intersect(object, maxDistance) does the exact test against
+    // the object and returns the distance of the hit or a negative number for a miss, nodes
+    // further than the closest hit so far are skipped, nearer children are visited first
+    // ------------------------------------------------------------------------
+    template <typename Intersect>
+    RayHit raycast(const float* origin, const float* direction, float maxDistance, const Intersect& intersect) const
+    {
+        RayHit result;
+        result.distance = maxDistance;
+        if (root < 0)
+            return result;
+        float inverse[3];
+        for (int k = 0; k < 3; k++)
+            inverse[k] = direction[k] != 0.0f ? 1.0f / direction[k] : (std::signbit(direction[k]) ? -FLT_MAX : FLT_MAX);
+
+        std::vector<int> stack;
+        stack.push_back(root);
+        while (!stack.empty())
+        {
+            int index = stack.back();
+            stack.pop_back();
+            const Node& node = nodes[index];
+            if (slab(node.box, origin, inverse) > result.distance)
+                continue;
+            if (node.left < 0)
+            {
+                float distance = intersect(proxies[node.proxy].object, result.distance);
+                if (distance >= 0.0f && distance <= result.distance)
+                {
+                    result.object = proxies[node.proxy].object;
+                    result.distance = distance;
+                    result.hit = true;
+                }
+                continue;
+            }
+            float left = slab(nodes[node.left].box, origin, inverse);
+            float right = slab(nodes[node.right].box, origin, inverse);
+            // the nearer one goes on top
+            if (left < right)
+            {
+                if (right <= result.distance)
+                    stack.push_back(node.right);
+                if (left <= result.distance)
+                    stack.push_back(node.left);
+            }
+            else
+            {
+                if (left <= result.distance)
+                    stack.push_back(node.left);
+                if (right <= result.distance)
+                    stack.push_back(node.right);
+            }
+        }
+        return result;
+    }
+
+    // the grown box the tree keeps for the proxy
+    const Aabb& bounds(int proxy) const { return proxies[proxy].box; }
+    uint32_t object(int proxy) const { return proxies[proxy].object; }
+    bool rebuilding() const { return rebuild != nullptr; }
+
+private:
+    struct Node
+    {
+        Aabb box;
+        int parent = -1;
+        // both -1 for leaves
+        int left = -1;
+        int right = -1;
+        int proxy = -1;
+    };
+
+    struct Proxy
+    {
+        Aabb box;
+        int leaf = -1;
+        uint32_t object = 0;
+        bool alive = false;
+        // touched since the running rebuild took its snapshot
+        bool changed = false;
+    };
+
+    struct BuildLeaf
+    {
+        Aabb box;
+        float center[3];
+        int proxy;
+    };
+
+    struct Rebuild
+    {
+        std::vector<BuildLeaf> leaves;
+        std::vector<Node> nodes;
+        int root = -1;
+        std::atomic<bool> done{ false };
+    };
+
+    // parent of a node on the free list
+    static const int freeMarker = -2;
+
+    float margin;
+    JobSystem& jobs;
+    std::vector<Node> nodes;
+    std::vector<int> freeNodes;
+    int root = -1;
+    std::vector<Proxy> proxies;
+    std::vector<int> freeProxies;
+    std::vector<int> refitLeaves;
+    float builtCost = 0.0f;
+
+    std::shared_ptr<Rebuild> rebuild;
+    std::vector<int> changedProxies;
+
+    void changed(int proxy)
+    {
+        if (rebuild && !proxies[proxy].changed)
+        {
+            proxies[proxy].changed = true;
+            changedProxies.push_back(proxy);
+        }
+    }
+
+    int allocateNode()
+    {
+        if (freeNodes.empty())
+        {
+            nodes.push_back(Node());
+            return static_cast<int>(nodes.size()) - 1;
+        }
+        int node = freeNodes.back();
+        freeNodes.pop_back();
+        nodes[node] = Node();
+        return node;
+    }
+
+    void freeNode(int node)
+    {
+        nodes[node].parent = freeMarker;
+        nodes[node].left = nodes[node].right = -1;
+        freeNodes.push_back(node);
+    }
+
+    // Finds the sibling that makes the tree grow the least: the cost of pairing with a node is
+    // the area of the new parent plus how much every ancestor grows. A subtree is skipped when
+    // even a perfect fit below it can't beat the best so far.
+    // ------------------------------------------------------------------------
+    int insertLeaf(int proxy)
+    {
+        int leaf = allocateNode();
+        nodes[leaf].box = proxies[proxy].box;
+        nodes[leaf].proxy = proxy;
+        if (root < 0)
+        {
+            root = leaf;
+            return leaf;
+        }
+
+        Aabb box = nodes[leaf].box;
+        float boxArea = box.area();
+        int best = root;
+        float bestCost = Aabb::merge(nodes[root].box, box).area();
+        struct Candidate
+        {
+            int node;
+            // growth of the ancestors above node
+            float inherited;
+        };
+        std::vector<Candidate> candidates;
+        candidates.push_back(Candidate{ root, 0.0f });
+        while (!candidates.empty())
+        {
+            Candidate candidate = candidates.back();
+            candidates.pop_back();
+            const Node& node = nodes[candidate.node];
+            float merged = Aabb::merge(node.box, box).area();
+            float cost = merged + candidate.inherited;
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                best = candidate.node;
+            }
+            float inherited = candidate.inherited + merged - node.box.area();
+            if (node.left >= 0 && boxArea + inherited < bestCost)
+            {
+                candidates.push_back(Candidate{ node.left, inherited });
+                candidates.push_back(Candidate{ node.right, inherited });
+            }
+        }
+
+        int oldParent = nodes[best].parent;
+        int parent = allocateNode();
+        nodes[parent].parent = oldParent;
+        nodes[parent].box = Aabb::merge(nodes[best].box, box);
+        nodes[parent].left = best;
+        nodes[parent].right = leaf;
+        nodes[best].parent = parent;
+        nodes[leaf].parent = parent;
+        if (oldParent < 0)
+            root = parent;
+        else if (nodes[oldParent].left == best)
+            nodes[oldParent].left = parent;
+        else
+            nodes[oldParent].right = parent;
+        refitFrom(oldParent);
+        return leaf;
+    }
+
+    void removeLeaf(int leaf)
+    {
+        int parent = nodes[leaf].parent;
+        freeNode(leaf);
+        if (parent < 0)
+        {
+            root = -1;
+            return;
+        }
+        int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+        int grandParent = nodes[parent].parent;
+        nodes[sibling].parent = grandParent;
+        if (grandParent < 0)
+            root = sibling;
+        else if (nodes[grandParent].left == parent)
+            nodes[grandParent].left = sibling;
+        else
+            nodes[grandParent].right = sibling;
+        freeNode(parent);
+        refitFrom(grandParent);
+    }
+
+    void refitFrom(int node)
+    {
+        for (; node >= 0; node = nodes[node].parent)
+            nodes[node].box = Aabb::merge(nodes[nodes[node].left].box, nodes[nodes[node].right].box);
+    }
+
+    std::vector<BuildLeaf> collectLeaves() const
+    {
+        std::vector<BuildLeaf> leaves;
+        for (size_t i = 0; i < proxies.size(); i++)
+        {
+            if (!proxies[i].alive)
+                continue;
+            BuildLeaf leaf;
+            leaf.box = proxies[i].box;
+            for (int k = 0; k < 3; k++)
+                leaf.center[k] = (leaf.box.min[k] + leaf.box.max[k]) * 0.5f;
+            leaf.proxy = static_cast<int>(i);
+            leaves.push_back(leaf);
+        }
+        return leaves;
+    }
+
+    // points every proxy at its leaf in a freshly built tree
+    void relink()
+    {
+        for (Proxy& p : proxies)
+            p.leaf = -1;
+        for (size_t i = 0; i < nodes.size(); i++)
+            if (nodes[i].left < 0)
+                proxies[nodes[i].proxy].leaf = static_cast<int>(i);
+    }
+
+    void startRebuild()
+    {
+        rebuild = std::make_shared<Rebuild>();
+        rebuild->leaves = collectLeaves();
+        // the task only touches its own copy, so the tree can be changed or destroyed meanwhile
+        std::shared_ptr<Rebuild> job = rebuild;
+        if (jobs.threadCount() == 0)
+        {
+            job->root = build(job->leaves, job->nodes);
+            job->done = true;
+            return;
+        }
+        jobs.run([job]()
+        {
+            job->root = build(job->leaves, job->nodes);
+            job->done = true;
+        });
+    }
+
+    void adoptRebuild()
+    {
+        nodes.swap(rebuild->nodes);
+        root = rebuild->root;
+        rebuild.reset();
+        freeNodes.clear();
+        relink();
+        // the snapshot has old boxes for whatever changed since, or objects removed since
+        for (int proxy : changedProxies)
+        {
+            Proxy& p = proxies[proxy];
+            p.changed = false;
+            if (p.leaf >= 0)
+                removeLeaf(p.leaf);
+            p.leaf = p.alive ? insertLeaf(proxy) : -1;
+        }
+        changedProxies.clear();
+        builtCost = cost();
+    }
+
+    // Top down binned SAH build: each node is split along its longest centroid axis at the bin
+    // boundary with the lowest area * count on both sides. Leaves hold one proxy each, the same
+    // as inserted ones, so the tree can keep being changed afterwards
+    // ------------------------------------------------------------------------
+    static int build(std::vector<BuildLeaf>& leaves, std::vector<Node>& out)
+    {
+        out.clear();
+        if (leaves.empty())
+            return -1;
+        out.reserve(leaves.size() * 2 - 1);
+        struct Task
+        {
+            size_t begin;
+            size_t end;
+            int parent;
+            bool left;
+        };
+        std::vector<Task> tasks;
+        tasks.push_back(Task{ 0, leaves.size(), -1, false });
+        const int binCount = 16;
+        while (!tasks.empty())
+        {
+            Task task = tasks.back();
+            tasks.pop_back();
+            int index = static_cast<int>(out.size());
+            out.push_back(Node());
+            out[index].parent = task.parent;
+            if (task.parent >= 0)
+                (task.left ? out[task.parent].left : out[task.parent].right) = index;
+
+            Aabb box = leaves[task.begin].box;
+            float centerMin[3], centerMax[3];
+            for (int k = 0; k < 3; k++)
+                centerMin[k] = centerMax[k] = leaves[task.begin].center[k];
+            for (size_t i = task.begin + 1; i < task.end; i++)
+            {
+                box = Aabb::merge(box, leaves[i].box);
+                for (int k = 0; k < 3; k++)
+                {
+                    centerMin[k] = std::min(centerMin[k], leaves[i].center[k]);
+                    centerMax[k] = std::max(centerMax[k], leaves[i].center[k]);
+                }
+            }
+            out[index].box = box;
+            if (task.end - task.begin == 1)
+            {
+                out[index].proxy = leaves[task.begin].proxy;
+                continue;
+            }
+
+            int axis = 0;
+            for (int k = 1; k < 3; k++)
+                if (centerMax[k] - centerMin[k] > centerMax[axis] - centerMin[axis])
+                    axis = k;
+            float extent = centerMax[axis] - centerMin[axis];
+            size_t middle = task.begin + (task.end - task.begin) / 2;
+            if (extent > 0.0f)
+            {
+                struct Bin
+                {
+                    Aabb box;
+                    size_t count = 0;
+                };
+                Bin bins[binCount];
+                float scale = binCount / extent;
+                auto binOf = [&](const BuildLeaf& leaf)
+                {
+                    return std::min(binCount - 1, static_cast<int>((leaf.center[axis] - centerMin[axis]) * scale));
+                };
+                for (size_t i = task.begin; i < task.end; i++)
+                {
+                    Bin& bin = bins[binOf(leaves[i])];
+                    bin.box = bin.count == 0 ? leaves[i].box : Aabb::merge(bin.box, leaves[i].box);
+                    bin.count++;
+                }
+                // areas of everything right of each boundary, then sweep from the left
+                float rightCost[binCount] = {};
+                Aabb accumulated;
+                size_t count = 0;
+                for (int b = binCount - 1; b > 0; b--)
+                {
+                    if (bins[b].count > 0)
+                    {
+                        accumulated = count == 0 ? bins[b].box : Aabb::merge(accumulated, bins[b].box);
+                        count += bins[b].count;
+                    }
+                    rightCost[b] = count > 0 ? accumulated.area() * count : 0.0f;
+                }
+                float bestCost = FLT_MAX;
+                int bestSplit = -1;
+                count = 0;
+                for (int b = 0; b < binCount - 1; b++)
+                {
+                    if (bins[b].count > 0)
+                    {
+                        accumulated = count == 0 ? bins[b].box : Aabb::merge(accumulated, bins[b].box);
+                        count += bins[b].count;
+                    }
+                    if (count == 0 || count == task.end - task.begin)
+                        continue;
+                    float splitCost = accumulated.area() * count + rightCost[b + 1];
+                    if (splitCost < bestCost)
+                    {
+                        bestCost = splitCost;
+                        bestSplit = b;
+                    }
+                }
+                if (bestSplit >= 0)
+                {
+                    BuildLeaf* split = std::partition(leaves.data() + task.begin, leaves.data() + task.end,
+                        [&](const BuildLeaf& leaf) { return binOf(leaf) <= bestSplit; });
+                    middle = static_cast<size_t>(split - leaves.data());
+                }
+            }
+            else
+            {
+                // every center in the same place, any split is as good
+                middle = task.begin + (task.end - task.begin) / 2;
+            }
+            tasks.push_back(Task{ middle, task.end, index, false });
+            tasks.push_back(Task{ task.begin, middle, index, true });
+        }
+        return 0;
+    }
+
+    // 1 when the box is fully inside the plane, -1 when fully outside, 0 when it straddles it
+    static int classify(const Plane& p, const Aabb& box)
+    {
+        float center = p.a * (box.min[0] + box.max[0]) + p.b * (box.min[1] + box.max[1]) + p.c * (box.min[2] + box.max[2]);
+        float radius = std::fabs(p.a) * (box.max[0] - box.min[0]) + std::fabs(p.b) * (box.max[1] - box.min[1]) + std::fabs(p.c) * (box.max[2] - box.min[2]);
+        // both doubled, d with them
+        float distance = center + 2.0f * p.d;
+        if (distance < -radius)
+            return -1;
+        return distance >= radius ? 1 : 0;
+    }
+
+    // entry distance of the ray into the box, FLT_MAX when it misses
+    static float slab(const Aabb& box, const float* origin, const float* inverse)
+    {
+        float enter = 0.0f, exit = FLT_MAX;
+        for (int k = 0; k < 3; k++)
+        {
+            float t0 = (box.min[k] - origin[k]) * inverse[k];
+            float t1 = (box.max[k] - origin[k]) * inverse[k];
+            enter = std::max(enter, std::min(t0, t1));
+            exit = std::min(exit, std::max(t0, t1));
+        }
+        return enter <= exit ? enter : FLT_MAX;
+    }
+
+    template <typename Visit>
+    void visitAll(int start, const Visit& visit) const
+    {
+        std::vector<int> stack(1, start);
+        while (!stack.empty())
+        {
+            const Node& node = nodes[stack.back()];
+            stack.pop_back();
+            if (node.left < 0)
+            {
+                visit(proxies[node.proxy].object);
+                continue;
+            }
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+
+    template <typename Test, typename Visit>
+    void traverse(const Test& test, const Visit& visit) const
+    {
+        if (root < 0)
+            return;
+        std::vector<int> stack(1, root);
+        while (!stack.empty())
+        {
+            const Node& node = nodes[stack.back()];
+            stack.pop_back();
+            if (!test(node.box))
+                continue;
+            if (node.left < 0)
+            {
+                visit(proxies[node.proxy].object);
+                continue;
+            }
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+};
+
+#endif
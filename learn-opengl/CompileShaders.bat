@@ -0,0 +1,19 @@
+@echo off
+rem Compiles the GLSL shaders to SPIR-V for OpenGL (glslangValidator -G).
+rem The program loads the .spv files when they exist and falls back to the .txt sources otherwise.
+rem glslangValidator comes with the Vulkan SDK.
+
+setlocal
+cd /d "%~dp0"
+
+set GLSLANG=glslangValidator
+if defined VULKAN_SDK set GLSLANG="%VULKAN_SDK%\Bin\glslangValidator.exe"
+
+%GLSLANG% --version >nul 2>&1
+if errorlevel 1 (
+    echo CompileShaders: glslangValidator not found, the program will compile the GLSL at runtime
+    exit /b 0
+)
+
+%GLSLANG% -G -S vert -o VertexShader.spv VertexShader.txt || exit /b 1
+%GLSLANG% -G -S frag -o FragmentShader.spv FragmentShader.txt || exit /b 1
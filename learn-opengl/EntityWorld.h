@@ -0,0 +1,529 @@
+#ifndef ENTITY_WORLD_H
+#define ENTITY_WORLD_H
+
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Names an entity. The generation tells a destroyed entity apart from a new one that got the
+// same index.
+struct Entity
+{
+    uint32_t index;
+    uint32_t generation;
+
+    bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const Entity& other) const { return !(*this == other); }
+};
+
+namespace entity_detail
+{
+    // up to 64 component types, a set of them is a bit mask
+    const uint32_t maxComponents = 64;
+    // bytes of one chunk, the components of an archetype share it as one array each
+    const size_t chunkBytes = 16 * 1024;
+
+    struct ComponentInfo
+    {
+        size_t size;
+        size_t alignment;
+    };
+
+    inline std::vector<ComponentInfo>& components()
+    {
+        static std::vector<ComponentInfo> list;
+        return list;
+    }
+
+    inline uint32_t registerComponent(size_t size, size_t alignment)
+    {
+        static std::mutex mutex;
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<ComponentInfo>& list = components();
+        // a 65th type has no bit in the masks, nothing could store or find it
+        if (list.size() == maxComponents)
+        {
+            std::cout << "ERROR::ENTITY_WORLD::TOO_MANY_COMPONENT_TYPES: " << maxComponents << std::endl;
+            std::abort();
+        }
+        list.push_back(ComponentInfo{ size, alignment });
+        return static_cast<uint32_t>(list.size() - 1);
+    }
+
+    // Components are moved around with memcpy and never constructed or destroyed, so they
+    // have to be plain data
+    template <typename T>
+    uint32_t typeId()
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "components have to be trivially copyable");
+        static_assert(alignof(T) <= alignof(std::max_align_t), "components can't be aligned more than std::max_align_t");
+        static const uint32_t id = registerComponent(sizeof(T), alignof(T));
+        return id;
+    }
+
+    // const T in a query is the same component as T, only read
+    template <typename T>
+    uint32_t componentId()
+    {
+        return typeId<typename std::remove_cv<T>::type>();
+    }
+
+    inline uint64_t maskOf()
+    {
+        return 0;
+    }
+
+    template <typename T, typename... Rest>
+    uint64_t maskOf(const T*, const Rest*... rest)
+    {
+        return (uint64_t(1) << componentId<T>()) | maskOf(rest...);
+    }
+
+    // Every entity with the same set of components. Their components are in chunks, each chunk
+    // has an array of every component plus one of the entities, all capacity long, and the
+    // entities fill the chunks in order without gaps.
+    struct Archetype
+    {
+        uint64_t mask = 0;
+        std::vector<uint32_t> componentIds;
+        // byte offset of each component's array in a chunk, by component id
+        size_t offsets[maxComponents] = {};
+        size_t capacity = 0;
+        // chunkBytes, more when a single row doesn't fit into that
+        size_t chunkSize = chunkBytes;
+        std::vector<std::unique_ptr<std::max_align_t[]>> chunks;
+        size_t count = 0;
+
+        // ------------------------------------------------------------------------
+        explicit Archetype(uint64_t mask)
+            : mask(mask)
+        {
+            size_t rowBytes = sizeof(Entity);
+            for (uint32_t id = 0; id < maxComponents; id++)
+            {
+                if (mask & (uint64_t(1) << id))
+                {
+                    componentIds.push_back(id);
+                    rowBytes += components()[id].size;
+                }
+            }
+            // every array may need alignment padding in front of it
+            capacity = std::max<size_t>(1, (chunkBytes - componentIds.size() * alignof(std::max_align_t)) / rowBytes);
+            size_t offset = capacity * sizeof(Entity);
+            for (uint32_t id : componentIds)
+            {
+                size_t alignment = components()[id].alignment;
+                offset = (offset + alignment - 1) / alignment * alignment;
+                offsets[id] = offset;
+                offset += capacity * components()[id].size;
+            }
+            chunkSize = std::max(chunkBytes, offset);
+        }
+
+        size_t chunkCount() const { return chunks.size(); }
+        size_t rowsIn(size_t chunk) const { return std::min(capacity, count - chunk * capacity); }
+
+        unsigned char* chunkData(size_t chunk) const { return reinterpret_cast<unsigned char*>(chunks[chunk].get()); }
+        Entity* entities(size_t chunk) const { return reinterpret_cast<Entity*>(chunkData(chunk)); }
+        void* component(uint32_t id, size_t chunk, size_t row) const { return chunkData(chunk) + offsets[id] + row * components()[id].size; }
+
+        template <typename T>
+        T* column(size_t chunk) const { return reinterpret_cast<T*>(chunkData(chunk) + offsets[componentId<T>()]); }
+
+        // a row at the end, the caller fills in every component
+        // ------------------------------------------------------------------------
+        size_t push(Entity entity)
+        {
+            if (count == chunks.size() * capacity)
+            {
+                size_t words = (chunkSize + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t);
+                chunks.emplace_back(new std::max_align_t[words]);
+            }
+            size_t row = count++;
+            entities(row / capacity)[row % capacity] = entity;
+            return row;
+        }
+
+        // moves the last row into row, returns the entity that moved there (the removed one
+        // when it was the last)
+        // ------------------------------------------------------------------------
+        Entity removeRow(size_t row)
+        {
+            size_t last = --count;
+            size_t chunk = row / capacity, at = row % capacity;
+            size_t lastChunk = last / capacity, lastAt = last % capacity;
+            Entity moved = entities(lastChunk)[lastAt];
+            if (row != last)
+            {
+                entities(chunk)[at] = moved;
+                for (uint32_t id : componentIds)
+                    std::memcpy(component(id, chunk, at), component(id, lastChunk, lastAt), components()[id].size);
+            }
+            // keeps one empty chunk around so an entity moving back and forth doesn't allocate
+            if (chunks.size() > (count + capacity - 1) / capacity + 1)
+                chunks.pop_back();
+            return moved;
+        }
+    };
+}
+
+// Entity component storage by archetype: all entities with exactly the same set of component
+// types are stored together, every component type in its own tightly packed array (chunks of
+// 16KB, or one row when a row is bigger). A query walks only the archetypes that have all the
+// components asked for and reads their arrays front to back, there are no lookups per entity
+// and no pointers to chase.
+//
+// Components are plain structs (trivially copyable), each type gets a bit on first use, up to
+// 64 types (a 65th aborts). Adding or removing a component moves the entity to another
+// archetype, so keep structural changes (create, destroy, add, remove) out of queries and
+// systems; changing the values is fine and different chunks can be changed from different
+// threads.
+class EntityWorld
+{
+public:
+    // ------------------------------------------------------------------------
+    explicit EntityWorld(JobSystem& jobs = JobSystem::shared())
+        : jobs(jobs)
+    {
+    }
+
+    EntityWorld(const EntityWorld&) = delete;
+    EntityWorld& operator=(const EntityWorld&) = delete;
+
+    // the bits of a set of component types, for SystemScheduler
+    // ------------------------------------------------------------------------
+    template <typename... Components>
+    static uint64_t mask()
+    {
+        return entity_detail::maskOf(static_cast<const Components*>(nullptr)...);
+    }
+
+    // makes an entity with these components
+    // ------------------------------------------------------------------------
+    template <typename... Components>
+    Entity create(const Components&... values)
+    {
+        Entity entity;
+        if (!freeIndices.empty())
+        {
+            entity.index = freeIndices.back();
+            freeIndices.pop_back();
+        }
+        else
+        {
+            entity.index = static_cast<uint32_t>(records.size());
+            records.push_back(Record());
+        }
+        entity.generation = records[entity.index].generation;
+
+        uint32_t archetype = archetypeFor(mask<Components...>());
+        place(entity, archetype);
+        int expand[] = { 0, (write(entity, values), 0)... };
+        (void)expand;
+        return entity;
+    }
+
+    // ------------------------------------------------------------------------
+    void destroy(Entity entity)
+    {
+        if (!alive(entity))
+            return;
+        Record& record = records[entity.index];
+        unplace(record);
+        record.generation++;
+        record.archetype = noArchetype;
+        freeIndices.push_back(entity.index);
+    }
+
+    bool alive(Entity entity) const
+    {
+        return entity.index < records.size() && records[entity.index].generation == entity.generation &&
+            records[entity.index].archetype != noArchetype;
+    }
+
+    template <typename T>
+    bool has(Entity entity) const
+    {
+        return alive(entity) && (archetypes[records[entity.index].archetype]->mask & mask<T>()) != 0;
+    }
+
+    // the entity's component, nullptr when it has none of that type
+    // ------------------------------------------------------------------------
+    template <typename T>
+    T* get(Entity entity) const
+    {
+        if (!has<T>(entity))
+            return nullptr;
+        const Record& record = records[entity.index];
+        const entity_detail::Archetype& archetype = *archetypes[record.archetype];
+        return static_cast<T*>(archetype.component(entity_detail::componentId<T>(), record.row / archetype.capacity, record.row % archetype.capacity));
+    }
+
+    // adds a component or sets it when the entity already has one
+    // ------------------------------------------------------------------------
+    template <typename T>
+    void add(Entity entity, const T& value)
+    {
+        if (!alive(entity))
+            return;
+        if (!has<T>(entity))
+            move(entity, archetypes[records[entity.index].archetype]->mask | mask<T>());
+        write(entity, value);
+    }
+
+    // ------------------------------------------------------------------------
+    template <typename T>
+    void remove(Entity entity)
+    {
+        if (has<T>(entity))
+            move(entity, archetypes[records[entity.index].archetype]->mask & ~mask<T>());
+    }
+
+    // Calls function(count, entities, arrays...) for every chunk of entities that have all of
+    // Components, with one array per component type. The fastest way through: the loop over
+    // the arrays is the caller's and can be vectorised
+    // ------------------------------------------------------------------------
+    template <typename... Components, typename Function>
+    void eachChunk(Function function)
+    {
+        uint64_t required = mask<Components...>();
+        for (const std::unique_ptr<entity_detail::Archetype>& archetype : archetypes)
+        {
+            if ((archetype->mask & required) != required)
+                continue;
+            for (size_t chunk = 0; chunk < archetype->chunkCount() && chunk * archetype->capacity < archetype->count; chunk++)
+                function(archetype->rowsIn(chunk), static_cast<const Entity*>(archetype->entities(chunk)), archetype->template column<Components>(chunk)...);
+        }
+    }
+
+    // calls function(entity, components...) for every entity that has all of Components
+    // ------------------------------------------------------------------------
+    template <typename... Components, typename Function>
+    void each(Function function)
+    {
+        eachChunk<Components...>([&](size_t count, const Entity* entities, Components*... arrays)
+        {
+            for (size_t i = 0; i < count; i++)
+                function(entities[i], arrays[i]...);
+        });
+    }
+
+    // eachChunk with the chunks spread over the job system, function runs on several threads
+    // at once
+    // ------------------------------------------------------------------------
+    template <typename... Components, typename Function>
+    void parallelEachChunk(Function function)
+    {
+        uint64_t required = mask<Components...>();
+        std::vector<std::pair<const entity_detail::Archetype*, size_t>> chunks;
+        for (const std::unique_ptr<entity_detail::Archetype>& archetype : archetypes)
+        {
+            if ((archetype->mask & required) != required)
+                continue;
+            for (size_t chunk = 0; chunk * archetype->capacity < archetype->count; chunk++)
+                chunks.emplace_back(archetype.get(), chunk);
+        }
+        jobs.parallelFor(chunks.size(), 1, [&](size_t first, size_t last)
+        {
+            for (size_t i = first; i < last; i++)
+            {
+                const entity_detail::Archetype& archetype = *chunks[i].first;
+                size_t chunk = chunks[i].second;
+                function(archetype.rowsIn(chunk), static_cast<const Entity*>(archetype.entities(chunk)), archetype.template column<Components>(chunk)...);
+            }
+        });
+    }
+
+    // each with the chunks spread over the job system
+    // ------------------------------------------------------------------------
+    template <typename... Components, typename Function>
+    void parallelEach(Function function)
+    {
+        parallelEachChunk<Components...>([&](size_t count, const Entity* entities, Components*... arrays)
+        {
+            for (size_t i = 0; i < count; i++)
+                function(entities[i], arrays[i]...);
+        });
+    }
+
+    // how many entities have all of Components
+    // ------------------------------------------------------------------------
+    template <typename... Components>
+    size_t count() const
+    {
+        uint64_t required = mask<Components...>();
+        size_t total = 0;
+        for (const std::unique_ptr<entity_detail::Archetype>& archetype : archetypes)
+            if ((archetype->mask & required) == required)
+                total += archetype->count;
+        return total;
+    }
+
+    size_t archetypeCount() const { return archetypes.size(); }
+
+private:
+    static const uint32_t noArchetype = 0xffffffffu;
+
+    // where an entity's components are
+    struct Record
+    {
+        uint32_t generation = 0;
+        uint32_t archetype = noArchetype;
+        size_t row = 0;
+    };
+
+    JobSystem& jobs;
+    std::vector<Record> records;
+    std::vector<uint32_t> freeIndices;
+    std::vector<std::unique_ptr<entity_detail::Archetype>> archetypes;
+    std::unordered_map<uint64_t, uint32_t> archetypeByMask;
+
+    uint32_t archetypeFor(uint64_t mask)
+    {
+        auto found = archetypeByMask.find(mask);
+        if (found != archetypeByMask.end())
+            return found->second;
+        uint32_t index = static_cast<uint32_t>(archetypes.size());
+        archetypes.emplace_back(new entity_detail::Archetype(mask));
+        archetypeByMask[mask] = index;
+        return index;
+    }
+
+    void place(Entity entity, uint32_t archetype)
+    {
+        Record& record = records[entity.index];
+        record.archetype = archetype;
+        record.row = archetypes[archetype]->push(entity);
+    }
+
+    void unplace(const Record& record)
+    {
+        Entity moved = archetypes[record.archetype]->removeRow(record.row);
+        records[moved.index].row = record.row;
+    }
+
+    template <typename T>
+    void write(Entity entity, const T& value)
+    {
+        std::memcpy(get<T>(entity), &value, sizeof(T));
+    }
+
+    // takes the entity to the archetype of mask, keeping the components both have
+    void move(Entity entity, uint64_t mask)
+    {
+        Record& record = records[entity.index];
+        uint32_t target = archetypeFor(mask);
+        // archetypeFor can add one, so the references are taken after it
+        entity_detail::Archetype& from = *archetypes[record.archetype];
+        entity_detail::Archetype& to = *archetypes[target];
+        size_t row = to.push(entity);
+        size_t fromChunk = record.row / from.capacity, fromAt = record.row % from.capacity;
+        for (uint32_t id : to.componentIds)
+            if (from.mask & (uint64_t(1) << id))
+                std::memcpy(to.component(id, row / to.capacity, row % to.capacity), from.component(id, fromChunk, fromAt), entity_detail::components()[id].size);
+        Record old = record;
+        unplace(old);
+        record.archetype = target;
+        record.row = row;
+    }
+};
+
+// Runs systems (functions over an EntityWorld) in the order they were added, but systems that
+// don't touch the same components run at the same time. Each system says which component
+// types it reads and which it writes; one that writes a type waits for the earlier ones that
+// read or write it, and the other way round. Every system is a job that depends on the ones it
+// has to wait for, so it starts as soon as those are done rather than when a whole phase is.
+// Systems can use parallelEach themselves, waiting jobs run other work meanwhile.
+class SystemScheduler
+{
+public:
+    // ------------------------------------------------------------------------
+    explicit SystemScheduler(JobSystem& jobs = JobSystem::shared())
+        : jobs(jobs)
+    {
+    }
+
+    // reads and writes are masks from EntityWorld::mask
+    // ------------------------------------------------------------------------
+    void add(const std::string& name, uint64_t reads, uint64_t writes, std::function<void(EntityWorld&)> function)
+    {
+        // runs after the earlier systems it conflicts with, one phase after the last of them
+        size_t phase = 0;
+        std::vector<size_t> after;
+        for (size_t earlier = 0; earlier < systems.size(); earlier++)
+        {
+            const System& other = systems[earlier];
+            bool conflict = (writes & (other.reads | other.writes)) != 0 || (other.writes & reads) != 0;
+            if (conflict)
+            {
+                phase = std::max(phase, other.phase + 1);
+                after.push_back(earlier);
+            }
+        }
+        systems.push_back(System{ name, reads, writes, phase, std::move(after), std::move(function) });
+        if (phases.size() <= phase)
+            phases.resize(phase + 1);
+        phases[phase].push_back(systems.size() - 1);
+    }
+
+    // runs every system once
+    // ------------------------------------------------------------------------
+    void run(EntityWorld& world)
+    {
+        JobHandle frame = jobs.create(std::function<void()>());
+        std::vector<JobHandle> started(systems.size());
+        for (size_t i = 0; i < systems.size(); i++)
+        {
+            started[i] = jobs.create([this, i, &world]() { systems[i].function(world); }, frame);
+            for (size_t earlier : systems[i].after)
+                jobs.depend(started[i], started[earlier]);
+        }
+        for (const JobHandle& system : started)
+            jobs.submit(system);
+        jobs.submit(frame);
+        jobs.wait(frame);
+    }
+
+    // which systems can run together, for checking the order is the one intended
+    // ------------------------------------------------------------------------
+    void print() const
+    {
+        for (size_t phase = 0; phase < phases.size(); phase++)
+        {
+            std::cout << "Phase " << phase << ":";
+            for (size_t system : phases[phase])
+                std::cout << " " << systems[system].name;
+            std::cout << std::endl;
+        }
+    }
+
+private:
+    struct System
+    {
+        std::string name;
+        uint64_t reads;
+        uint64_t writes;
+        size_t phase;
+        // earlier systems it has to wait for
+        std::vector<size_t> after;
+        std::function<void(EntityWorld&)> function;
+    };
+
+    JobSystem& jobs;
+    std::vector<System> systems;
+    std::vector<std::vector<size_t>> phases;
+};
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#ifdef _WIN32
+// Sleep is only accurate to ~15ms unless the system timer resolution is raised
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+// glad defined APIENTRY already, windows.h defines it again (same as glad.c does)
+#undef APIENTRY
+#include <windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+// Controls when a frame starts, when input is sampled and how buffer swaps are synced
+//
+// VSync      swap interval 1, frame rate locked to the display
+// Immediate  swap interval 0, renders as fast as possible (tears)
+// Adaptive   swap interval -1, syncs when on time and tears when late (falls back to vsync
+//            when the driver lacks *_swap_control_tear)
+// Capped     swap interval 0, frames are started on a fixed grid of 1/targetFps
+// LowLatency swap interval 1, input sampling is delayed so processInput/glfwPollEvents happen
+//            as late as possible while still making the next vblank
+class FramePacer
+{
+public:
+    enum class Mode { VSync, Immediate, Adaptive, Capped, LowLatency };
+
+    // targetFps of 0 means use the refresh rate of the primary monitor
+    // ------------------------------------------------------------------------
+    FramePacer(Mode mode = Mode::VSync, double targetFps = 0.0)
+    {
+#ifdef _WIN32
+        timeBeginPeriod(1);
+#endif
+        setMode(mode, targetFps);
+    }
+
+    ~FramePacer()
+    {
+#ifdef _WIN32
+        timeEndPeriod(1);
+#endif
+    }
+
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    // ------------------------------------------------------------------------
+    void setMode(Mode newMode, double targetFps = 0.0)
+    {
+        mode = newMode;
+        // kept so cycling through the modes comes back to the same cap
+        requestedFps = targetFps;
+        if (targetFps <= 0.0)
+        {
+            const GLFWvidmode* videoMode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+            targetFps = videoMode && videoMode->refreshRate > 0 ? videoMode->refreshRate : 60.0;
+        }
+        period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetFps));
+
+        int interval = 1;
+        if (mode == Mode::Immediate || mode == Mode::Capped)
+            interval = 0;
+        else if (mode == Mode::Adaptive && (glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear")))
+            interval = -1;
+        glfwSwapInterval(interval);
+
+        workTime = Clock::duration::zero();
+        frameStart = Clock::now();
+        nextDeadline = frameStart + period;
+    }
+
+    // ------------------------------------------------------------------------
+    void cycleMode()
+    {
+        setMode(static_cast<Mode>((static_cast<int>(mode) + 1) % 5), requestedFps);
+    }
+
+    Mode getMode() const { return mode; }
+
+    static const char* modeName(Mode mode)
+    {
+        switch (mode)
+        {
+        case Mode::VSync: return "vsync";
+        case Mode::Immediate: return "immediate";
+        case Mode::Adaptive: return "adaptive";
+        case Mode::Capped: return "capped";
+        default: return "low latency";
+        }
+    }
+
+    // call right before glfwPollEvents/processInput at the top of the render loop
+    // ------------------------------------------------------------------------
+    void waitForInputSample()
+    {
+        if (mode == Mode::LowLatency)
+        {
+            // sample input just early enough for the (measured) frame work to finish before the vblank
+            const std::chrono::microseconds safetyMargin(1500);
+            Clock::time_point wake = nextDeadline - workTime - safetyMargin;
+            sleepUntil(wake);
+        }
+        inputSampled = Clock::now();
+    }
+
+    // call right before glfwSwapBuffers, the frame's work is measured up to here so the
+    // estimate doesn't include the wait for the vblank in the swap
+    // ------------------------------------------------------------------------
+    void markWorkDone()
+    {
+        if (mode == Mode::LowLatency)
+        {
+            // the GPU's part of the work counts too
+            glFinish();
+        }
+        workDone = Clock::now();
+    }
+
+    // call right after glfwSwapBuffers
+    // ------------------------------------------------------------------------
+    void endFrame()
+    {
+        if (mode == Mode::LowLatency)
+        {
+            // stops the driver from queueing frames so the swap really returns at the vblank
+            glFinish();
+            Clock::time_point now = Clock::now();
+            // work estimate tracks increases immediately and decays slowly, a spike costs one frame of latency
+            // instead of a missed vblank every other frame
+            // without a markWorkDone this frame the swap's wait is counted as work
+            Clock::time_point done = workDone >= inputSampled ? workDone : now;
+            Clock::duration work = done - inputSampled;
+            workTime = work > workTime ? work : workTime - (workTime - work) / 16;
+            workTime = std::min(workTime, period);
+            // the swap returned at a vblank so the next one is a period away
+            nextDeadline = now + period;
+        }
+        else if (mode == Mode::Capped)
+        {
+            sleepUntil(nextDeadline);
+            Clock::time_point now = Clock::now();
+            // a late frame starts a new grid instead of trying to catch up with short frames
+            nextDeadline = now - nextDeadline > period ? now + period : nextDeadline + period;
+        }
+
+        Clock::time_point now = Clock::now();
+        frameTime = now - frameStart;
+        frameStart = now;
+    }
+
+    // seconds between the last two endFrame calls
+    double lastFrameTime() const
+    {
+        return std::chrono::duration<double>(frameTime).count();
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    Mode mode = Mode::VSync;
+    Clock::duration period{};
+    Clock::duration workTime{};
+    Clock::duration frameTime{};
+    Clock::time_point frameStart;
+    Clock::time_point nextDeadline;
+    Clock::time_point inputSampled;
+    Clock::time_point workDone;
+    double requestedFps = 0.0;
+
+    // OS sleep for most of the wait, then spin for the last bit since sleeps overshoot
+    static void sleepUntil(Clock::time_point target)
+    {
+        const std::chrono::microseconds spinThreshold(2000);
+        Clock::time_point now = Clock::now();
+        if (target - now > spinThreshold)
+            std::this_thread::sleep_for(target - now - spinThreshold);
+        while (Clock::now() < target)
+            std::this_thread::yield();
+    }
+};
+
+#endif
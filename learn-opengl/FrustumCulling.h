@@ -0,0 +1,325 @@
+#ifndef FRUSTUM_CULLING_H
+#define FRUSTUM_CULLING_H
+
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Widest instruction set the compiler lets us use: AVX-512 tests 16 bounds at a time, AVX 8
+// and SSE2 (every x64 CPU) 4. Build with /arch:AVX2 or /arch:AVX512 on MSVC for the wide paths.
+#if defined(__AVX512F__)
+#define FRUSTUM_CULLING_AVX512 1
+#include <immintrin.h>
+#elif defined(__AVX__)
+#define FRUSTUM_CULLING_AVX 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || (defined(_MSC_VER) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)))
+#define FRUSTUM_CULLING_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// ax + by + cz + d = 0 with (a, b, c) pointing into the frustum
+struct Plane
+{
+    float a, b, c, d;
+};
+
+struct Frustum
+{
+    // left, right, bottom, top, near, far
+    Plane planes[6];
+
+    // planes of a column major view projection matrix (glm::value_ptr), for GL's -w..w clip
+    // space. Everything is in world space when the matrix is projection * view
+    // ------------------------------------------------------------------------
+    static Frustum fromMatrix(const float* m)
+    {
+        // row i of the matrix is m[i], m[4 + i], m[8 + i], m[12 + i]
+        auto combine = [m](int row, float sign)
+        {
+            Plane plane = { m[3] + sign * m[row], m[7] + sign * m[4 + row], m[11] + sign * m[8 + row], m[15] + sign * m[12 + row] };
+            float length = std::sqrt(plane.a * plane.a + plane.b * plane.b + plane.c * plane.c);
+            if (length > 0.0f)
+            {
+                plane.a /= length;
+                plane.b /= length;
+                plane.c /= length;
+                plane.d /= length;
+            }
+            return plane;
+        };
+        Frustum frustum;
+        frustum.planes[0] = combine(0, 1.0f);
+        frustum.planes[1] = combine(0, -1.0f);
+        frustum.planes[2] = combine(1, 1.0f);
+        frustum.planes[3] = combine(1, -1.0f);
+        frustum.planes[4] = combine(2, 1.0f);
+        frustum.planes[5] = combine(2, -1.0f);
+        return frustum;
+    }
+};
+
+// Bounding spheres stored as one array per component, so SIMD loads pick up the same
+// component of consecutive objects
+struct SphereBounds
+{
+    std::vector<float> x, y, z, radius;
+
+    size_t size() const { return x.size(); }
+
+    void add(float centerX, float centerY, float centerZ, float sphereRadius)
+    {
+        x.push_back(centerX);
+        y.push_back(centerY);
+        z.push_back(centerZ);
+        radius.push_back(sphereRadius);
+    }
+
+    void set(size_t i, float centerX, float centerY, float centerZ, float sphereRadius)
+    {
+        x[i] = centerX;
+        y[i] = centerY;
+        z[i] = centerZ;
+        radius[i] = sphereRadius;
+    }
+
+    void clear()
+    {
+        x.clear();
+        y.clear();
+        z.clear();
+        radius.clear();
+    }
+};
+
+// Axis aligned boxes as center and half size, one array per component
+struct BoxBounds
+{
+    std::vector<float> x, y, z, extentX, extentY, extentZ;
+
+    size_t size() const { return x.size(); }
+
+    void add(float centerX, float centerY, float centerZ, float halfX, float halfY, float halfZ)
+    {
+        x.push_back(centerX);
+        y.push_back(centerY);
+        z.push_back(centerZ);
+        extentX.push_back(halfX);
+        extentY.push_back(halfY);
+        extentZ.push_back(halfZ);
+    }
+
+    void addMinMax(const float* min, const float* max)
+    {
+        add((min[0] + max[0]) * 0.5f, (min[1] + max[1]) * 0.5f, (min[2] + max[2]) * 0.5f,
+            (max[0] - min[0]) * 0.5f, (max[1] - min[1]) * 0.5f, (max[2] - min[2]) * 0.5f);
+    }
+
+    void clear()
+    {
+        x.clear();
+        y.clear();
+        z.clear();
+        extentX.clear();
+        extentY.clear();
+        extentZ.clear();
+    }
+};
+
+// Indices of the objects that passed, in increasing order
+struct VisibleList
+{
+    const uint32_t* indices;
+    size_t count;
+
+    const uint32_t* begin() const { return indices; }
+    const uint32_t* end() const { return indices + count; }
+    size_t size() const { return count; }
+};
+
+namespace frustum_culling_detail
+{
+    // A bound is outside when it is fully behind one plane: distance of the center < -radius.
+    // For a box the radius along a plane's normal is |a| * extentX + |b| * extentY + |c| * extentZ
+    inline bool visible(const Frustum& frustum, const SphereBounds& bounds, size_t i)
+    {
+        for (const Plane& p : frustum.planes)
+            if (p.a * bounds.x[i] + p.b * bounds.y[i] + p.c * bounds.z[i] + p.d < -bounds.radius[i])
+                return false;
+        return true;
+    }
+
+    inline bool visible(const Frustum& frustum, const BoxBounds& bounds, size_t i)
+    {
+        for (const Plane& p : frustum.planes)
+        {
+            float radius = std::fabs(p.a) * bounds.extentX[i] + std::fabs(p.b) * bounds.extentY[i] + std::fabs(p.c) * bounds.extentZ[i];
+            if (p.a * bounds.x[i] + p.b * bounds.y[i] + p.c * bounds.z[i] + p.d < -radius)
+                return false;
+        }
+        return true;
+    }
+
+#if defined(FRUSTUM_CULLING_AVX512) || defined(FRUSTUM_CULLING_AVX) || defined(FRUSTUM_CULLING_SSE2)
+    // lanes of floats and a mask of the lanes that passed, as bits
+#if defined(FRUSTUM_CULLING_AVX512)
+    const int width = 16;
+    typedef __m512 Vf;
+    inline Vf load(const float* p) { return _mm512_loadu_ps(p); }
+    inline Vf set1(float f) { return _mm512_set1_ps(f); }
+    inline Vf madd(Vf a, Vf b, Vf c) { return _mm512_fmadd_ps(a, b, c); }
+    inline Vf mul(Vf a, Vf b) { return _mm512_mul_ps(a, b); }
+    inline Vf add(Vf a, Vf b) { return _mm512_add_ps(a, b); }
+    inline unsigned int inside(Vf distance, Vf radius) { return _mm512_cmp_ps_mask(_mm512_add_ps(distance, radius), _mm512_setzero_ps(), _CMP_GE_OQ); }
+#elif defined(FRUSTUM_CULLING_AVX)
+    const int width = 8;
+    typedef __m256 Vf;
+    inline Vf load(const float* p) { return _mm256_loadu_ps(p); }
+    inline Vf set1(float f) { return _mm256_set1_ps(f); }
+    inline Vf mul(Vf a, Vf b) { return _mm256_mul_ps(a, b); }
+    inline Vf add(Vf a, Vf b) { return _mm256_add_ps(a, b); }
+    inline Vf madd(Vf a, Vf b, Vf c) { return add(mul(a, b), c); }
+    inline unsigned int inside(Vf distance, Vf radius) { return _mm256_movemask_ps(_mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_GE_OQ)); }
+#else
+    const int width = 4;
+    typedef __m128 Vf;
+    inline Vf load(const float* p) { return _mm_loadu_ps(p); }
+    inline Vf set1(float f) { return _mm_set1_ps(f); }
+    inline Vf mul(Vf a, Vf b) { return _mm_mul_ps(a, b); }
+    inline Vf add(Vf a, Vf b) { return _mm_add_ps(a, b); }
+    inline Vf madd(Vf a, Vf b, Vf c) { return add(mul(a, b), c); }
+    inline unsigned int inside(Vf distance, Vf radius) { return _mm_movemask_ps(_mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps())); }
+#endif
+
+    inline Vf distance(const Plane& p, Vf x, Vf y, Vf z)
+    {
+        return madd(set1(p.a), x, madd(set1(p.b), y, madd(set1(p.c), z, set1(p.d))));
+    }
+
+    inline unsigned int visibleMask(const Frustum& frustum, const SphereBounds& bounds, size_t i)
+    {
+        Vf x = load(&bounds.x[i]), y = load(&bounds.y[i]), z = load(&bounds.z[i]), radius = load(&bounds.radius[i]);
+        unsigned int mask = ~0u;
+        for (const Plane& p : frustum.planes)
+            mask &= inside(distance(p, x, y, z), radius);
+        return mask;
+    }
+
+    inline unsigned int visibleMask(const Frustum& frustum, const BoxBounds& bounds, size_t i)
+    {
+        Vf x = load(&bounds.x[i]), y = load(&bounds.y[i]), z = load(&bounds.z[i]);
+        Vf ex = load(&bounds.extentX[i]), ey = load(&bounds.extentY[i]), ez = load(&bounds.extentZ[i]);
+        unsigned int mask = ~0u;
+        for (const Plane& p : frustum.planes)
+        {
+            // the absolute values are per plane, so they are scalars broadcast to every lane
+            Vf radius = madd(set1(std::fabs(p.a)), ex, madd(set1(std::fabs(p.b)), ey, mul(set1(std::fabs(p.c)), ez)));
+            mask &= inside(distance(p, x, y, z), radius);
+        }
+        return mask;
+    }
+#endif
+
+    // writes the indices of the visible bounds in [begin, end) to out, returns how many
+    // ------------------------------------------------------------------------
+    template <typename Bounds>
+    size_t cullRange(const Frustum& frustum, const Bounds& bounds, size_t begin, size_t end, uint32_t* out)
+    {
+        size_t count = 0;
+        size_t i = begin;
+#if defined(FRUSTUM_CULLING_AVX512) || defined(FRUSTUM_CULLING_AVX) || defined(FRUSTUM_CULLING_SSE2)
+        for (; i + width <= end; i += width)
+        {
+            unsigned int mask = visibleMask(frustum, bounds, i);
+            // every lane is written and the count only moves past the visible ones, no branches
+            for (int lane = 0; lane < width; lane++)
+            {
+                out[count] = static_cast<uint32_t>(i + lane);
+                count += (mask >> lane) & 1u;
+            }
+        }
+#endif
+        for (; i < end; i++)
+        {
+            out[count] = static_cast<uint32_t>(i);
+            count += visible(frustum, bounds, i) ? 1 : 0;
+        }
+        return count;
+    }
+}
+
+// Tests bounds against a frustum and returns the indices of the ones at least partly inside.
+// Large counts are split into blocks culled in parallel on the job system; every block
+// writes into its own part of the output which is then squeezed together.
+class FrustumCuller
+{
+public:
+    // ------------------------------------------------------------------------
+    explicit FrustumCuller(JobSystem& jobs = JobSystem::shared(), size_t blockSize = 16384)
+        : jobs(jobs), blockSize(blockSize)
+    {
+    }
+
+    // the list stays valid until the next call
+    // ------------------------------------------------------------------------
+    VisibleList cull(const Frustum& frustum, const SphereBounds& bounds)
+    {
+        return run(frustum, bounds);
+    }
+
+    VisibleList cull(const Frustum& frustum, const BoxBounds& bounds)
+    {
+        return run(frustum, bounds);
+    }
+
+private:
+    JobSystem& jobs;
+    size_t blockSize;
+    std::unique_ptr<uint32_t[]> output;
+    size_t capacity = 0;
+    std::vector<size_t> blockCounts;
+
+    template <typename Bounds>
+    VisibleList run(const Frustum& frustum, const Bounds& bounds)
+    {
+        size_t count = bounds.size();
+        if (count > capacity)
+        {
+            // no clearing, every slot is written before it is read
+            output.reset(new uint32_t[count]);
+            capacity = count;
+        }
+
+        size_t blocks = (count + blockSize - 1) / blockSize;
+        if (blocks <= 1 || jobs.threadCount() == 0)
+        {
+            VisibleList result = { output.get(), frustum_culling_detail::cullRange(frustum, bounds, 0, count, output.get()) };
+            return result;
+        }
+
+        blockCounts.resize(blocks);
+        jobs.parallelFor(blocks, 1, [&](size_t first, size_t last)
+        {
+            for (size_t block = first; block < last; block++)
+            {
+                size_t begin = block * blockSize;
+                blockCounts[block] = frustum_culling_detail::cullRange(frustum, bounds, begin, std::min(count, begin + blockSize), output.get() + begin);
+            }
+        });
+        size_t visible = blockCounts[0];
+        for (size_t block = 1; block < blocks; block++)
+        {
+            std::memmove(output.get() + visible, output.get() + block * blockSize, blockCounts[block] * sizeof(uint32_t));
+            visible += blockCounts[block];
+        }
+        VisibleList result = { output.get(), visible };
+        return result;
+    }
+};
+
+#endif
@@ -0,0 +1,23 @@
+// Shader storage blocks of the GPU culling pass, the C++ side of these is in GpuCulling.h
+#ifndef GPU_CULLING_GLSL
+#define GPU_CULLING_GLSL
+
+// model matrix of every object, the vertex shader reads it too when drawing the culled commands
+layout (std430, binding = 0) readonly buffer ObjectTransforms
+{
+    mat4 objectTransforms[];
+};
+
+// the textures of every object, the same as in the ObjectData uniform block
+struct ObjectTextures
+{
+    vec4 regions[2];
+    ivec4 layers;
+};
+
+layout (std430, binding = 4) readonly buffer ObjectTextureBuffer
+{
+    ObjectTextures objectTextures[];
+};
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include <glm/glm/glm.hpp>
+
+#include "FrustumCulling.h"
+#include "HiZBuffer.h"
+#include "ProgramPipeline.h"
+#include "ShaderPreprocessor.h"
+#include "Transforms.h"
+
+// std430 ObjectBounds in CullingShader.txt: bounding sphere in the object's own space (center,
+// radius) and the indexed draw that shows the object
+struct GpuObjectBounds
+{
+    float sphere[4];
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t baseVertex;
+    uint32_t padding;
+};
+
+// what glMultiDrawElementsIndirect reads for every draw
+struct DrawElementsIndirectCommand
+{
+    uint32_t count;
+    uint32_t instanceCount;
+    uint32_t firstIndex;
+    int32_t baseVertex;
+    uint32_t baseInstance;
+};
+
+// std430 ObjectTextures in GpuCulling.glsl, the same as textureRegions and textureLayers of
+// ObjectData: offset xy and scale zw of both textures in the texture array, and their layers
+struct GpuObjectTextures
+{
+    float regions[2][4];
+    int32_t layers[4];
+};
+
+static_assert(sizeof(GpuObjectBounds) == 32, "GpuObjectBounds has to match the std430 ObjectBounds");
+static_assert(sizeof(DrawElementsIndirectCommand) == 20, "DrawElementsIndirectCommand has to be 20 bytes");
+static_assert(sizeof(GpuObjectTextures) == 48, "GpuObjectTextures has to match the std430 ObjectTextures");
+
+// Culls objects on the GPU. The transforms and bounds of every object live in shader storage
+// buffers, a compute pass (CullingShader.txt) tests them against the frustum and optionally a
+// Hi-Z pyramid of the last frame's depth (HiZBuffer.h), then writes a draw command for each
+// visible one plus how many there are, and the draws are issued from those buffers with
+// glMultiDrawElementsIndirectCount. The CPU never looks at single objects, for a static scene
+// it uploads them once and then only sets the frustum.
+//
+// The vertex shader finds its object through an instanced attribute holding 0, 1, 2, ...:
+// every command's baseInstance is its object index so the attribute reads exactly that. This
+// works without gl_BaseInstance / gl_DrawID (GL 4.6 or ARB_shader_draw_parameters).
+//
+// Without GL 4.6 or ARB_indirect_parameters (llvmpipe and older drivers) the count can't be
+// read from a buffer, so the commands are zeroed before culling and all of them are drawn with
+// glMultiDrawElementsIndirect: the ones past the count have no instances and draw nothing.
+class GpuCuller
+{
+public:
+    // shader storage bindings, the same as in CullingShader.txt and GpuCulling.glsl
+    static const unsigned int transformBinding = 0;
+    static const unsigned int boundsBinding = 1;
+    static const unsigned int commandBinding = 2;
+    static const unsigned int countBinding = 3;
+    static const unsigned int textureBinding = 4;
+
+    // ------------------------------------------------------------------------
+    explicit GpuCuller(size_t capacity, const char* shaderPath = "CullingShader.txt",
+        ShaderPreprocessor& preprocessor = ShaderPreprocessor::shared())
+        : capacity(capacity)
+    {
+        cullStage = ShaderStage::fromSource(GL_COMPUTE_SHADER, preprocessor.expand(shaderPath));
+        int linked = 0;
+        glGetProgramiv(cullStage.ID, GL_LINK_STATUS, &linked);
+        supported = linked != 0;
+
+        // 4.6 has it in core, the extension has the same function with an ARB suffix
+        if (GLAD_GL_VERSION_4_6)
+            multiDrawIndirectCount = reinterpret_cast<MultiDrawElementsIndirectCount>(glfwGetProcAddress("glMultiDrawElementsIndirectCount"));
+        else if (glfwExtensionSupported("GL_ARB_indirect_parameters"))
+            multiDrawIndirectCount = reinterpret_cast<MultiDrawElementsIndirectCount>(glfwGetProcAddress("glMultiDrawElementsIndirectCountARB"));
+
+        glCreateBuffers(1, &transformBuffer);
+        glNamedBufferStorage(transformBuffer, capacity * sizeof(glm::mat4), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        glCreateBuffers(1, &boundsBuffer);
+        glNamedBufferStorage(boundsBuffer, capacity * sizeof(GpuObjectBounds), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        glCreateBuffers(1, &textureBuffer);
+        glNamedBufferStorage(textureBuffer, capacity * sizeof(GpuObjectTextures), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        // only ever written by the GPU
+        glCreateBuffers(1, &commandBuffer);
+        glNamedBufferStorage(commandBuffer, capacity * sizeof(DrawElementsIndirectCommand), nullptr, 0);
+        glCreateBuffers(1, &countBuffer);
+        glNamedBufferStorage(countBuffer, sizeof(uint32_t), nullptr, 0);
+
+        std::vector<uint32_t> indices(capacity);
+        for (size_t i = 0; i < capacity; i++)
+            indices[i] = static_cast<uint32_t>(i);
+        glCreateBuffers(1, &objectIndexBuffer);
+        glNamedBufferStorage(objectIndexBuffer, capacity * sizeof(uint32_t), indices.data(), 0);
+    }
+
+    ~GpuCuller()
+    {
+        glDeleteProgram(cullStage.ID);
+        unsigned int buffers[] = { transformBuffer, boundsBuffer, textureBuffer, commandBuffer, countBuffer, objectIndexBuffer };
+        glDeleteBuffers(6, buffers);
+    }
+
+    GpuCuller(const GpuCuller&) = delete;
+    GpuCuller& operator=(const GpuCuller&) = delete;
+
+    // false when the culling shader didn't compile, draw the objects some other way then
+    bool isSupported() const { return supported; }
+    // false when the fallback without the count buffer is used
+    bool hasIndirectCount() const { return multiDrawIndirectCount != nullptr; }
+
+    // Adds the instanced object index attribute at location to a vertex array, it has to be
+    // declared in the vertex shader as "in uint" at that location
+    // ------------------------------------------------------------------------
+    void bindObjectIndex(unsigned int vertexArray, unsigned int location) const
+    {
+        // the binding index is the location, like the bindings glVertexAttribPointer makes
+        glVertexArrayVertexBuffer(vertexArray, location, objectIndexBuffer, 0, sizeof(uint32_t));
+        glVertexArrayAttribIFormat(vertexArray, location, 1, GL_UNSIGNED_INT, 0);
+        glVertexArrayAttribBinding(vertexArray, location, location);
+        glVertexArrayBindingDivisor(vertexArray, location, 1);
+        glEnableVertexArrayAttrib(vertexArray, location);
+    }
+
+    // Replaces the objects, the first count get culled and drawn from now on. transforms can be
+    // null when they come from a TransformBuffer
+    // ------------------------------------------------------------------------
+    void setObjects(const glm::mat4* transforms, const GpuObjectBounds* bounds, size_t count)
+    {
+        if (count > capacity)
+        {
+            std::cout << "ERROR::GPU_CULLING::TOO_MANY_OBJECTS: " << count << ", room for " << capacity << std::endl;
+            count = capacity;
+        }
+        objectCount = count;
+        if (transforms)
+            setTransforms(transforms, 0, count);
+        if (count > 0)
+            glNamedBufferSubData(boundsBuffer, 0, count * sizeof(GpuObjectBounds), bounds);
+    }
+
+    // updates the transforms of objects [first, first + count), for the ones that moved
+    // ------------------------------------------------------------------------
+    void setTransforms(const glm::mat4* transforms, size_t first, size_t count)
+    {
+        if (count > 0 && first + count <= capacity)
+            glNamedBufferSubData(transformBuffer, first * sizeof(glm::mat4), count * sizeof(glm::mat4), transforms);
+    }
+
+    // updates which textures objects [first, first + count) are drawn with
+    // ------------------------------------------------------------------------
+    void setTextures(const GpuObjectTextures* textures, size_t first, size_t count)
+    {
+        if (count > 0 && first + count <= capacity)
+            glNamedBufferSubData(textureBuffer, first * sizeof(GpuObjectTextures), count * sizeof(GpuObjectTextures), textures);
+    }
+
+    // Reads the transforms from this frame's segment of a TransformBuffer instead of its own
+    // buffer, so they can be composed straight into mapped memory. nullptr goes back to its own
+    // ------------------------------------------------------------------------
+    void setTransformBuffer(const TransformBuffer* buffer)
+    {
+        externalTransforms = buffer;
+    }
+
+    // Writes the draw commands of the objects at least partly inside frustum. With occluders
+    // the ones hidden behind last frame's depth are dropped too, previousViewProjection is the
+    // view projection that depth was drawn with. Leaves the culling program bound, so use the
+    // shader to draw with afterwards
+    // ------------------------------------------------------------------------
+    void cull(const Frustum& frustum, const HiZBuffer* occluders = nullptr, const glm::mat4& previousViewProjection = glm::mat4(1.0f))
+    {
+        glClearNamedBufferData(countBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+        if (!hasIndirectCount() && objectCount > 0)
+            glClearNamedBufferSubData(commandBuffer, GL_R32UI, 0, objectCount * sizeof(DrawElementsIndirectCommand), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+        if (objectCount == 0)
+            return;
+
+        glProgramUniform4fv(cullStage.ID, 0, 6, &frustum.planes[0].a);
+        glProgramUniform1ui(cullStage.ID, 6, static_cast<unsigned int>(objectCount));
+        bool occlusion = occluders && occluders->isBuilt();
+        glProgramUniform1i(cullStage.ID, 7, occlusion);
+        if (occlusion)
+        {
+            glProgramUniformMatrix4fv(cullStage.ID, 8, 1, GL_FALSE, &previousViewProjection[0][0]);
+            glBindTextureUnit(0, occluders->texture());
+        }
+        bindStorage();
+        glUseProgram(cullStage.ID);
+        glDispatchCompute(static_cast<unsigned int>((objectCount + 63) / 64), 1, 1);
+        // the draws read the commands and the count as indirect parameters
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+    }
+
+    // draws what the last cull kept, with the vertex array and shader already bound
+    // ------------------------------------------------------------------------
+    void draw(GLenum mode, GLenum indexType) const
+    {
+        if (objectCount == 0)
+            return;
+        bindTransforms();
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, textureBinding, textureBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        if (hasIndirectCount())
+        {
+            glBindBuffer(GL_PARAMETER_BUFFER, countBuffer);
+            multiDrawIndirectCount(mode, indexType, nullptr, 0, static_cast<GLsizei>(objectCount), 0);
+        }
+        else
+            glMultiDrawElementsIndirect(mode, indexType, nullptr, static_cast<GLsizei>(objectCount), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    size_t size() const { return objectCount; }
+
+private:
+    typedef void (APIENTRYP MultiDrawElementsIndirectCount)(GLenum mode, GLenum type, const void* indirect, GLintptr drawCount, GLsizei maxDrawCount, GLsizei stride);
+
+    size_t capacity;
+    size_t objectCount = 0;
+    ShaderStage cullStage;
+    bool supported = false;
+    MultiDrawElementsIndirectCount multiDrawIndirectCount = nullptr;
+    unsigned int transformBuffer = 0;
+    unsigned int boundsBuffer = 0;
+    unsigned int textureBuffer = 0;
+    unsigned int commandBuffer = 0;
+    unsigned int countBuffer = 0;
+    unsigned int objectIndexBuffer = 0;
+    const TransformBuffer* externalTransforms = nullptr;
+
+    void bindTransforms() const
+    {
+        if (externalTransforms)
+            externalTransforms->bind(transformBinding, objectCount);
+        else
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, transformBinding, transformBuffer);
+    }
+
+    void bindStorage() const
+    {
+        bindTransforms();
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, boundsBinding, boundsBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, commandBinding, commandBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, countBinding, countBuffer);
+    }
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef HI_Z_BUFFER_H
+#define HI_Z_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include "ProgramPipeline.h"
+#include "ShaderPreprocessor.h"
+
+// Hierarchical Z: a mip chain of the depth buffer where every texel holds the farthest depth of
+// the pixels under it. A few texel reads at the level where an object's screen rectangle is
+// about one texel wide tell whether everything there is nearer than the object, which means
+// it is hidden. GpuCuller uses it to drop occluded objects before they are drawn.
+//
+// It is built from the previous frame's depth, so this frame's draws can be culled before any
+// of them happened. Objects are projected with the previous frame's view projection for the
+// test, which lines them up with that depth while the camera moves. Something that only just
+// came out from behind an occluder shows up one frame late.
+class HiZBuffer
+{
+public:
+    // ------------------------------------------------------------------------
+    explicit HiZBuffer(const char* shaderPath = "HiZShader.txt", ShaderPreprocessor& preprocessor = ShaderPreprocessor::shared())
+    {
+        downsampleStage = ShaderStage::fromSource(GL_COMPUTE_SHADER, preprocessor.expand(shaderPath));
+        int linked = 0;
+        glGetProgramiv(downsampleStage.ID, GL_LINK_STATUS, &linked);
+        supported = linked != 0;
+    }
+
+    ~HiZBuffer()
+    {
+        release();
+        glDeleteProgram(downsampleStage.ID);
+    }
+
+    HiZBuffer(const HiZBuffer&) = delete;
+    HiZBuffer& operator=(const HiZBuffer&) = delete;
+
+    bool isSupported() const { return supported; }
+
+    // Copies the depth of framebuffer (0 is the window) and builds the pyramid from it. Call at
+    // the end of a frame, the depth format has to be GL_DEPTH24_STENCIL8 like GLFW's default
+    // ------------------------------------------------------------------------
+    void build(int framebufferWidth, int framebufferHeight, unsigned int framebuffer = 0)
+    {
+        if (!supported || framebufferWidth <= 0 || framebufferHeight <= 0)
+            return;
+        if (framebufferWidth != baseWidth || framebufferHeight != baseHeight)
+            resize(framebufferWidth, framebufferHeight);
+
+        // blits need matching depth formats, so the copy is made the same as the window's
+        glBlitNamedFramebuffer(framebuffer, depthFramebuffer, 0, 0, baseWidth, baseHeight, 0, 0, baseWidth, baseHeight,
+            GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+
+        glUseProgram(downsampleStage.ID);
+        glBindTextureUnit(0, depthTexture);
+        for (int level = 0; level < levelCount; level++)
+        {
+            glProgramUniform1i(downsampleStage.ID, 0, level == 0);
+            glBindImageTexture(0, pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            if (level > 0)
+                glBindImageTexture(1, pyramid, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+            glDispatchCompute((levelWidth(level) + 7) / 8, (levelHeight(level) + 7) / 8, 1);
+            // the next level reads this one
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        }
+        // the culling pass samples the pyramid as a texture
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        built = true;
+    }
+
+    // R32F texture with the whole chain, sample it with texelFetch or textureLod
+    unsigned int texture() const { return pyramid; }
+    // false until build ran once, there is nothing to test against before that
+    bool isBuilt() const { return built; }
+    // Forgets the pyramid, for when builds were skipped and it is from some older frame. Occlusion
+    // culling is off until the next build
+    void invalidate() { built = false; }
+    int width() const { return baseWidth; }
+    int height() const { return baseHeight; }
+    int levels() const { return levelCount; }
+
+private:
+    ShaderStage downsampleStage;
+    bool supported = false;
+    bool built = false;
+    int baseWidth = 0;
+    int baseHeight = 0;
+    int levelCount = 0;
+    unsigned int depthTexture = 0;
+    unsigned int depthFramebuffer = 0;
+    unsigned int pyramid = 0;
+
+    int levelWidth(int level) const { return std::max(1, baseWidth >> level); }
+    int levelHeight(int level) const { return std::max(1, baseHeight >> level); }
+
+    void resize(int width, int height)
+    {
+        release();
+        baseWidth = width;
+        baseHeight = height;
+        levelCount = 1;
+        while ((std::max(width, height) >> levelCount) > 0)
+            levelCount++;
+
+        glCreateTextures(GL_TEXTURE_2D, 1, &depthTexture);
+        glTextureStorage2D(depthTexture, 1, GL_DEPTH24_STENCIL8, width, height);
+        glCreateFramebuffers(1, &depthFramebuffer);
+        glNamedFramebufferTexture(depthFramebuffer, GL_DEPTH_STENCIL_ATTACHMENT, depthTexture, 0);
+        if (glCheckNamedFramebufferStatus(depthFramebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::HI_Z::FRAMEBUFFER_INCOMPLETE: " << width << "x" << height << std::endl;
+
+        glCreateTextures(GL_TEXTURE_2D, 1, &pyramid);
+        glTextureStorage2D(pyramid, levelCount, GL_R32F, width, height);
+        // texelFetch ignores these, they are only there so the texture is complete
+        glTextureParameteri(pyramid, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTextureParameteri(pyramid, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        built = false;
+    }
+
+    void release()
+    {
+        if (pyramid)
+            glDeleteTextures(1, &pyramid);
+        if (depthTexture)
+            glDeleteTextures(1, &depthTexture);
+        if (depthFramebuffer)
+            glDeleteFramebuffers(1, &depthFramebuffer);
+        pyramid = depthTexture = depthFramebuffer = 0;
+    }
+};
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef INPUT_QUEUE_H
+#define INPUT_QUEUE_H
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Lock free single producer/single consumer ring buffer. Capacity has to be a power of two
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two");
+
+public:
+    // producer side, returns false when the queue is full
+    // ------------------------------------------------------------------------
+    bool push(const T& value)
+    {
+        size_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail - headIndex.load(std::memory_order_acquire) == Capacity)
+            return false;
+        items[tail & (Capacity - 1)] = value;
+        tailIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, returns false when the queue is empty
+    // ------------------------------------------------------------------------
+    bool pop(T& value)
+    {
+        size_t head = headIndex.load(std::memory_order_relaxed);
+        if (head == tailIndex.load(std::memory_order_acquire))
+            return false;
+        value = items[head & (Capacity - 1)];
+        headIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T items[Capacity];
+    // on separate cache lines so producer and consumer don't fight over them
+    alignas(64) std::atomic<size_t> headIndex{ 0 };
+    alignas(64) std::atomic<size_t> tailIndex{ 0 };
+};
+
+// What the game reacts to, independent of which key is bound to it
+enum class InputAction : uint8_t
+{
+    None,
+    MoveUp,
+    MoveDown,
+    MoveLeft,
+    MoveRight,
+    BlendMore,
+    BlendLess,
+    Wireframe,
+    ToggleAnimation,
+    CyclePacing,
+    ToggleGpuCulling,
+    ToggleSprites,
+};
+
+// A GLFW key event stamped with the time it reached the callback
+struct InputEvent
+{
+    int key;
+    int scancode;
+    int action;
+    int mods;
+    // microseconds on the steady clock
+    int64_t timestamp;
+};
+
+// Maps keys to actions
+class ActionMap
+{
+public:
+    // ------------------------------------------------------------------------
+    void bind(int key, InputAction action)
+    {
+        if (key >= 0 && key <= GLFW_KEY_LAST)
+            bindings[key] = action;
+    }
+
+    InputAction lookup(int key) const
+    {
+        return key >= 0 && key <= GLFW_KEY_LAST ? bindings[key] : InputAction::None;
+    }
+
+private:
+    InputAction bindings[GLFW_KEY_LAST + 1] = {};
+};
+
+// Per event latency from the GLFW callback to the point the event was consumed
+struct InputLatencyStats
+{
+    uint64_t events = 0;
+    uint64_t dropped = 0;
+    int64_t totalMicroseconds = 0;
+    int64_t maxMicroseconds = 0;
+
+    double averageMilliseconds() const
+    {
+        return events ? totalMicroseconds / 1000.0 / events : 0.0;
+    }
+};
+
+// Input events go from the GLFW callbacks (producer) to whoever drains the queue (consumer),
+// so input handling and the thread that uses the state can be different threads. The consumer
+// decides where in the frame input is applied by choosing when to call drain.
+class InputQueue
+{
+public:
+    // called from the GLFW key callback
+    // ------------------------------------------------------------------------
+    void pushKey(int key, int scancode, int action, int mods)
+    {
+        InputEvent event = { key, scancode, action, mods, now() };
+        if (!events.push(event))
+            dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // calls handler(const InputEvent&, InputAction) for every queued event, oldest first
+    // ------------------------------------------------------------------------
+    template <typename Handler>
+    void drain(const ActionMap& actions, Handler&& handler)
+    {
+        InputEvent event;
+        while (events.pop(event))
+        {
+            int64_t latency = now() - event.timestamp;
+            stats.events++;
+            stats.totalMicroseconds += latency;
+            stats.maxMicroseconds = std::max(stats.maxMicroseconds, latency);
+            handler(event, actions.lookup(event.key));
+        }
+        stats.dropped = dropped.load(std::memory_order_relaxed);
+    }
+
+    // only valid on the consumer thread
+    const InputLatencyStats& latency() const { return stats; }
+
+    static int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    SpscQueue<InputEvent, 256> events;
+    std::atomic<uint64_t> dropped{ 0 };
+    InputLatencyStats stats;
+};
+
+#endif
@@ -0,0 +1,490 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace job_system_detail
+{
+    struct Job
+    {
+        // empty for a job that only groups its children
+        std::function<void()> function;
+        // finishing this one counts towards the parent's
+        std::shared_ptr<Job> parent;
+        // the job itself and its children that haven't finished
+        std::atomic<int> unfinished{ 1 };
+        // jobs it waits for that haven't finished, plus one until it is submitted
+        std::atomic<int> blockers{ 1 };
+        // jobs waiting for this one, released when it finishes
+        std::mutex mutex;
+        std::vector<std::shared_ptr<Job>> continuations;
+        bool finished = false;
+        // keeps the job alive while it is queued, the queues only hold raw pointers
+        std::shared_ptr<Job> self;
+    };
+
+    // Chase-Lev work stealing deque (in the C11 atomics form of Le, Pop, Cohen and Zappa
+    // Nardelli). Only the thread owning it pushes and pops, at the bottom, without locks; other
+    // threads steal from the top, a compare and swap decides who gets the last one. The array
+    // grows when full, old arrays are kept until the deque goes because a thief may still read
+    // one.
+    class WorkStealingDeque
+    {
+    public:
+        // ------------------------------------------------------------------------
+        explicit WorkStealingDeque(int64_t capacity = 1024)
+        {
+            arrays.emplace_back(new Array(capacity));
+            array.store(arrays.back().get(), std::memory_order_relaxed);
+        }
+
+        WorkStealingDeque(const WorkStealingDeque&) = delete;
+        WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+        // owner only
+        // ------------------------------------------------------------------------
+        void push(Job* job)
+        {
+            int64_t b = bottom.load(std::memory_order_relaxed);
+            int64_t t = top.load(std::memory_order_acquire);
+            Array* a = array.load(std::memory_order_relaxed);
+            if (b - t > a->capacity - 1)
+                a = grow(a, t, b);
+            a->put(b, job);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+
+        // owner only, the most recently pushed job
+        // ------------------------------------------------------------------------
+        Job* pop()
+        {
+            int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            Array* a = array.load(std::memory_order_relaxed);
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+            if (t > b)
+            {
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            Job* job = a->get(b);
+            if (t == b)
+            {
+                // the last one, a thief may be taking it right now
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    job = nullptr;
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return job;
+        }
+
+        // any thread, the oldest job. nullptr when empty or when another thread got it first
+        // ------------------------------------------------------------------------
+        Job* steal()
+        {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = bottom.load(std::memory_order_acquire);
+            if (t >= b)
+                return nullptr;
+            Array* a = array.load(std::memory_order_acquire);
+            Job* job = a->get(t);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return nullptr;
+            return job;
+        }
+
+        // can be out of date as soon as it returns, only a hint
+        bool empty() const
+        {
+            return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct Array
+        {
+            int64_t capacity;
+            std::unique_ptr<std::atomic<Job*>[]> items;
+
+            explicit Array(int64_t capacity)
+                : capacity(capacity), items(new std::atomic<Job*>[capacity])
+            {
+            }
+
+            Job* get(int64_t i) const { return items[i & (capacity - 1)].load(std::memory_order_relaxed); }
+            void put(int64_t i, Job* job) { items[i & (capacity - 1)].store(job, std::memory_order_relaxed); }
+        };
+
+        std::atomic<int64_t> top{ 0 };
+        std::atomic<int64_t> bottom{ 0 };
+        std::atomic<Array*> array;
+        std::vector<std::unique_ptr<Array>> arrays;
+
+        Array* grow(Array* old, int64_t t, int64_t b)
+        {
+            arrays.emplace_back(new Array(old->capacity * 2));
+            Array* bigger = arrays.back().get();
+            for (int64_t i = t; i < b; i++)
+                bigger->put(i, old->get(i));
+            array.store(bigger, std::memory_order_release);
+            return bigger;
+        }
+    };
+}
+
+// A job that has been created, see JobSystem
+typedef std::shared_ptr<job_system_detail::Job> JobHandle;
+
+// Work stealing job scheduler. Every worker thread has its own deque (Chase-Lev): jobs a
+// worker starts go to the bottom of its deque and it takes them back from there, newest
+// first while they are still in cache; a worker with nothing left steals the oldest job of
+// another one, usually the biggest piece of work that worker split off. Threads that aren't
+// workers put their jobs on one shared queue.
+//
+// Dependencies are continuations, there are no fibers: a job that has to wait for others
+// isn't queued until they have finished, so no thread ever blocks inside a job. A job can
+// also have a parent, the parent only counts as finished once all its children have. wait()
+// runs other jobs until the one waited for is done, so it can be called from inside a job
+// (nested parallelFor) and from threads that aren't workers.
+//
+//     JobHandle decode = jobs.run([&]() { ... });
+//     JobHandle upload = jobs.create([&]() { ... });
+//     jobs.depend(upload, decode);
+//     jobs.submit(upload);
+//     jobs.wait(upload);
+//
+// With no worker threads (one core) jobs run when a thread waits.
+class JobSystem
+{
+public:
+    // 0 threads means one per core minus the one that waits
+    // ------------------------------------------------------------------------
+    explicit JobSystem(unsigned int threadCount = 0)
+    {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+        for (unsigned int i = 0; i < threadCount; i++)
+            deques.emplace_back(new job_system_detail::WorkStealingDeque());
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back(&JobSystem::work, this, i);
+    }
+
+    // runs whatever is still queued first
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            running = false;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+        // only left when there were no workers
+        while (job_system_detail::Job* job = findWork())
+            execute(job);
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // A job that runs function once submitted and once every job it depends on has finished.
+    // With a parent, the parent isn't finished until this one is; create children before the
+    // parent finishes (inside its function, or before submitting it). An empty function makes
+    // a job that only waits for its children
+    // ------------------------------------------------------------------------
+    JobHandle create(std::function<void()> function, const JobHandle& parent = JobHandle())
+    {
+        JobHandle job = std::make_shared<job_system_detail::Job>();
+        job->function = std::move(function);
+        if (parent)
+        {
+            if (parent->unfinished.fetch_add(1) == 0)
+                std::cout << "ERROR::JOB_SYSTEM::PARENT_ALREADY_FINISHED" << std::endl;
+            job->parent = parent;
+        }
+        return job;
+    }
+
+    // job doesn't start before before has finished, call it before submitting job
+    // ------------------------------------------------------------------------
+    void depend(const JobHandle& job, const JobHandle& before)
+    {
+        std::lock_guard<std::mutex> lock(before->mutex);
+        if (before->finished)
+            return;
+        job->blockers.fetch_add(1);
+        before->continuations.push_back(job);
+    }
+
+    // the job runs as soon as its dependencies allow
+    // ------------------------------------------------------------------------
+    void submit(const JobHandle& job)
+    {
+        release(job);
+    }
+
+    // create and submit in one
+    // ------------------------------------------------------------------------
+    JobHandle run(std::function<void()> function, const JobHandle& parent = JobHandle())
+    {
+        JobHandle job = create(std::move(function), parent);
+        submit(job);
+        return job;
+    }
+
+    // the job and all its children have run
+    bool isDone(const JobHandle& job) const
+    {
+        return job->unfinished.load(std::memory_order_acquire) == 0;
+    }
+
+    // runs other jobs until job is done, the job has to be submitted
+    // ------------------------------------------------------------------------
+    void wait(const JobHandle& job)
+    {
+        while (!isDone(job))
+        {
+            if (job_system_detail::Job* next = findWork())
+                execute(next);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    // Calls function(begin, end) over [0, count) and returns when all of it is done. Never
+    // gives function fewer than grain items (except the last piece), but how finely the range
+    // is split beyond that adapts to the load: the range is halved only while the halves
+    // split off before have been stolen, i.e. while other threads are idle, otherwise it is
+    // worked through in pieces of about 1/64 of a thread's share. So a busy system runs it
+    // almost sequentially and an idle one spreads it over every thread
+    // ------------------------------------------------------------------------
+    template <typename Function>
+    void parallelFor(size_t count, size_t grain, const Function& function)
+    {
+        grain = std::max<size_t>(grain, 1);
+        if (count == 0)
+            return;
+        if (count <= grain || workers.empty())
+        {
+            function(size_t(0), count);
+            return;
+        }
+        size_t piece = std::max(grain, count / (64 * (workers.size() + 1)));
+        JobHandle group = create(std::function<void()>());
+        splitRange(0, count, piece, function, group);
+        // the group itself never runs, this drops the count it started with
+        finish(group);
+        wait(group);
+    }
+
+    unsigned int threadCount() const { return static_cast<unsigned int>(workers.size()); }
+
+    // one job system shared by everything that wants to go wide, so they don't each start their own threads
+    static JobSystem& shared()
+    {
+        static JobSystem jobs;
+        return jobs;
+    }
+
+private:
+    // which job system and deque the current thread works for
+    struct Worker
+    {
+        const JobSystem* system = nullptr;
+        size_t index = 0;
+    };
+
+    std::vector<std::unique_ptr<job_system_detail::WorkStealingDeque>> deques;
+    std::vector<std::thread> workers;
+    // jobs from threads that aren't workers
+    std::deque<job_system_detail::Job*> injected;
+    std::atomic<size_t> injectedCount{ 0 };
+    std::mutex injectedMutex;
+    // jobs in the deques and the shared queue
+    std::atomic<int64_t> queued{ 0 };
+    std::atomic<int> sleepers{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool running = true;
+
+    static Worker& currentWorker()
+    {
+        static thread_local Worker worker;
+        return worker;
+    }
+
+    bool isWorker() const { return currentWorker().system == this; }
+
+    void release(const JobHandle& job)
+    {
+        if (job->blockers.fetch_sub(1) == 1)
+            enqueue(job);
+    }
+
+    void enqueue(const JobHandle& job)
+    {
+        job->self = job;
+        if (isWorker())
+        {
+            deques[currentWorker().index]->push(job.get());
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(injectedMutex);
+            injected.push_back(job.get());
+            injectedCount.store(injected.size());
+        }
+        // a worker going to sleep counts itself before checking queued, so one of the two sees the other
+        queued.fetch_add(1);
+        if (sleepers.load() > 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+            }
+            wake.notify_one();
+        }
+    }
+
+    // the own deque first, then the shared queue, then stealing from the others
+    job_system_detail::Job* findWork()
+    {
+        job_system_detail::Job* job = nullptr;
+        size_t self = deques.size();
+        if (isWorker())
+        {
+            self = currentWorker().index;
+            job = deques[self]->pop();
+        }
+        if (!job && !injectedEmpty())
+        {
+            std::lock_guard<std::mutex> lock(injectedMutex);
+            if (!injected.empty())
+            {
+                job = injected.front();
+                injected.pop_front();
+                injectedCount.store(injected.size());
+            }
+        }
+        if (!job && !deques.empty())
+        {
+            // starts somewhere else on every thread so the thieves don't all go for the same victim
+            static thread_local uint32_t random = 0x9e3779b9u ^ static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+            size_t start = random % deques.size();
+            for (size_t i = 0; i < deques.size() && !job; i++)
+            {
+                size_t victim = (start + i) % deques.size();
+                if (victim != self)
+                    job = deques[victim]->steal();
+            }
+        }
+        if (job)
+            queued.fetch_sub(1);
+        return job;
+    }
+
+    bool injectedEmpty() const
+    {
+        return injectedCount.load(std::memory_order_relaxed) == 0;
+    }
+
+    // nothing queued that this thread would take before others could steal it
+    bool ownQueueEmpty()
+    {
+        return isWorker() ? deques[currentWorker().index]->empty() : injectedEmpty();
+    }
+
+    void execute(job_system_detail::Job* raw)
+    {
+        JobHandle job = std::move(raw->self);
+        if (job->function)
+            job->function();
+        // lets go of whatever the function captured now rather than when the last handle goes
+        job->function = nullptr;
+        finish(job);
+    }
+
+    // one less unfinished, when that was the last the continuations are released and the
+    // parent has one less
+    void finish(JobHandle job)
+    {
+        while (job && job->unfinished.fetch_sub(1) == 1)
+        {
+            std::vector<JobHandle> continuations;
+            {
+                std::lock_guard<std::mutex> lock(job->mutex);
+                job->finished = true;
+                continuations.swap(job->continuations);
+            }
+            for (const JobHandle& continuation : continuations)
+                release(continuation);
+            job = job->parent;
+        }
+    }
+
+    // lazy binary splitting: keeps half of what is left for another thread while none of the
+    // earlier halves are waiting in the queue
+    template <typename Function>
+    void splitRange(size_t begin, size_t end, size_t piece, const Function& function, const JobHandle& group)
+    {
+        while (begin < end)
+        {
+            // both halves and every piece stay at least piece long, a short tail goes with the last piece
+            if (end - begin >= 2 * piece && ownQueueEmpty())
+            {
+                size_t middle = begin + (end - begin) / 2;
+                run([this, middle, end, piece, &function, group]() { splitRange(middle, end, piece, function, group); }, group);
+                end = middle;
+                continue;
+            }
+            size_t last = end - begin < 2 * piece ? end : begin + piece;
+            function(begin, last);
+            begin = last;
+        }
+    }
+
+    void work(size_t index)
+    {
+        currentWorker().system = this;
+        currentWorker().index = index;
+        int idle = 0;
+        while (true)
+        {
+            if (job_system_detail::Job* job = findWork())
+            {
+                execute(job);
+                idle = 0;
+                continue;
+            }
+            // a steal can lose a race with work still queued, so a few more tries before sleeping
+            if (++idle < 64)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            if (!running && queued.load() == 0)
+                return;
+            sleepers.fetch_add(1);
+            wake.wait(lock, [this]() { return !running || queued.load() > 0; });
+            sleepers.fetch_sub(1);
+            idle = 0;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef MAPPED_RING_H
+#define MAPPED_RING_H
+
+#include <glad/glad.h>
+
+#include <vector>
+
+// One persistently mapped buffer cut into a segment per frame in flight. Each frame writes its
+// own segment through the mapping and a fence per segment keeps us from overwriting data the
+// GPU is still reading, so streaming data needs no glBufferSubData and no orphaning.
+// UniformBuffer, TransformBuffer and SpriteBatch are rings of their own kind of data on top.
+class MappedRing
+{
+public:
+    unsigned int ID;
+
+    // segments start at multiples of alignment, the offset alignment of whatever the segments
+    // are bound as (offsetAlignment) or 1 when they are only indexed into
+    // ------------------------------------------------------------------------
+    explicit MappedRing(GLsizeiptr segmentBytes, int framesInFlight = 3, GLsizeiptr alignment = 1)
+        : framesInFlight(framesInFlight)
+    {
+        segmentSize = (segmentBytes + alignment - 1) / alignment * alignment;
+
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glCreateBuffers(1, &ID);
+        glNamedBufferStorage(ID, segmentSize * framesInFlight, nullptr, flags);
+        mapped = static_cast<char*>(glMapNamedBufferRange(ID, 0, segmentSize * framesInFlight, flags));
+        fences.resize(framesInFlight, nullptr);
+    }
+
+    ~MappedRing()
+    {
+        for (GLsync fence : fences)
+            if (fence)
+                glDeleteSync(fence);
+        glUnmapNamedBuffer(ID);
+        glDeleteBuffers(1, &ID);
+    }
+
+    MappedRing(const MappedRing&) = delete;
+    MappedRing& operator=(const MappedRing&) = delete;
+
+    // every bound range has to start at a multiple of this, pname is e.g.
+    // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    // ------------------------------------------------------------------------
+    static GLsizeiptr offsetAlignment(GLenum pname)
+    {
+        int alignment = 256;
+        glGetIntegerv(pname, &alignment);
+        return alignment;
+    }
+
+    // moves to the next segment, waiting if the GPU is still using it
+    // ------------------------------------------------------------------------
+    void beginFrame()
+    {
+        segment = (segment + 1) % framesInFlight;
+        if (fences[segment])
+        {
+            glClientWaitSync(fences[segment], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            glDeleteSync(fences[segment]);
+            fences[segment] = nullptr;
+        }
+    }
+
+    // call after the last draw that reads this frame's segment
+    // ------------------------------------------------------------------------
+    void endFrame()
+    {
+        fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // this frame's segment, mapped memory that should only ever be written
+    char* data() const { return mapped + offset(); }
+    // byte offset of this frame's segment in the buffer
+    GLintptr offset() const { return segment * segmentSize; }
+    GLsizeiptr segmentBytes() const { return segmentSize; }
+
+private:
+    int framesInFlight;
+    GLsizeiptr segmentSize = 0;
+    char* mapped = nullptr;
+    std::vector<GLsync> fences;
+    int segment = 0;
+};
+
+#endif
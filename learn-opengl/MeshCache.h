@@ -0,0 +1,302 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "MeshLoader.h"
+#include "MeshOptimizer.h"
+#include "VertexFormat.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+// glad may have defined APIENTRY already, windows.h defines it again (same as glad.c does)
+#undef APIENTRY
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Read only memory map of a whole file. The OS pages it in as it is read, so nothing is copied
+// into our own memory before it goes to the GPU.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile(MappedFile&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        std::swap(bytes, other.bytes);
+        std::swap(length, other.length);
+        return *this;
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // ------------------------------------------------------------------------
+    bool open(const std::string& path)
+    {
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        HANDLE mapping = NULL;
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+            mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping)
+        {
+            bytes = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            length = bytes ? static_cast<size_t>(size.QuadPart) : 0;
+            // the view keeps the file mapped on its own
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view != MAP_FAILED)
+            {
+                bytes = static_cast<const unsigned char*>(view);
+                length = static_cast<size_t>(info.st_size);
+            }
+        }
+        ::close(fd);
+#endif
+        return bytes != nullptr;
+    }
+
+    void close()
+    {
+        if (!bytes)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(bytes);
+#else
+        munmap(const_cast<unsigned char*>(bytes), length);
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+};
+
+// A mesh in the exact bytes the GPU reads: vertices in a VertexFormat followed by the
+// indices, in one block so it uploads with a single buffer copy. Either owns the bytes
+// (right after packing) or points into a memory mapped cache file. Indices are 16 bit when
+// there are few enough vertices, half the index fetch bandwidth of 32 bit ones.
+class PackedMesh
+{
+public:
+    PackedMesh() = default;
+    PackedMesh(PackedMesh&&) = default;
+    PackedMesh& operator=(PackedMesh&&) = default;
+
+    // converts a mesh into format. Attributes are matched by location (see MeshAttribute),
+    // the ones the mesh doesn't have are filled with 0, colors with white
+    // ------------------------------------------------------------------------
+    static PackedMesh pack(const Mesh& mesh, const VertexFormat& format)
+    {
+        PackedMesh packed;
+        packed.header.vertexCount = mesh.vertexCount();
+        packed.header.indexCount = mesh.indices.size();
+        packed.header.indexSize = mesh.vertexCount() <= 0x10000 ? sizeof(uint16_t) : sizeof(uint32_t);
+        packed.header.stride = format.stride();
+        packed.header.indexOffset = (packed.header.vertexCount * format.stride() + 3) & ~uint64_t(3);
+        packed.owned.resize(packed.size());
+
+        size_t count = mesh.vertexCount();
+        for (const VertexFormat::Attribute& attribute : format.getAttributes())
+        {
+            const std::vector<float>* source = nullptr;
+            int components = 0;
+            float fill = 0.0f;
+            switch (attribute.location)
+            {
+            case MeshPosition: source = &mesh.positions; components = 3; break;
+            case MeshNormal: source = &mesh.normals; components = 3; break;
+            case MeshTexCoord: source = &mesh.texCoords; components = 2; break;
+            case MeshColor: source = &mesh.colors; components = 3; fill = 1.0f; break;
+            default: std::cout << "ERROR::MESH::NO_DATA_FOR_LOCATION: " << attribute.location << std::endl; break;
+            }
+            // reshape to what the attribute wants, packed types take 3 or 4 values as they are
+            int wanted = attribute.type == GL_INT_2_10_10_10_REV ? std::max(components, 3) : attribute.components;
+            std::vector<float> values(count * wanted, fill);
+            if (source && !source->empty())
+                for (size_t i = 0; i < count; i++)
+                    for (int k = 0; k < std::min(components, wanted); k++)
+                        values[i * wanted + k] = (*source)[i * components + k];
+            if (count > 0)
+                format.pack(packed.owned.data(), count, attribute.location, values.data(), wanted);
+        }
+        unsigned char* indices = packed.owned.data() + packed.header.indexOffset;
+        if (packed.header.indexSize == sizeof(uint16_t))
+        {
+            for (size_t i = 0; i < mesh.indices.size(); i++)
+            {
+                uint16_t index = static_cast<uint16_t>(mesh.indices[i]);
+                std::memcpy(indices + i * sizeof(uint16_t), &index, sizeof(uint16_t));
+            }
+        }
+        else if (!mesh.indices.empty())
+            std::memcpy(indices, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+        return packed;
+    }
+
+    // maps a cache file written by save, empty when it is missing or was made from another
+    // source or format (key)
+    // ------------------------------------------------------------------------
+    static PackedMesh open(const std::string& path, uint64_t key)
+    {
+        PackedMesh packed;
+        MappedFile file;
+        if (!file.open(path) || file.size() < sizeof(Header))
+            return packed;
+        Header header;
+        std::memcpy(&header, file.data(), sizeof(Header));
+        if (std::memcmp(header.magic, "LOGLMESH", 8) != 0 || header.version != Header::currentVersion || header.key != key ||
+            sizeof(Header) + header.indexOffset + header.indexCount * header.indexSize != file.size())
+            return packed;
+        packed.header = header;
+        packed.mapped = std::move(file);
+        return packed;
+    }
+
+    // ------------------------------------------------------------------------
+    bool save(const std::string& path, uint64_t key) const
+    {
+        Header saved = header;
+        saved.key = key;
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&saved), sizeof(Header));
+        file.write(reinterpret_cast<const char*>(data()), size());
+        if (!file)
+        {
+            std::cout << "ERROR::MESH::CACHE_NOT_WRITTEN: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // vertices then indices, what goes into the buffer
+    const unsigned char* data() const { return mapped.data() ? mapped.data() + sizeof(Header) : owned.data(); }
+    size_t size() const { return static_cast<size_t>(header.indexOffset + header.indexCount * header.indexSize); }
+    bool empty() const { return header.indexCount == 0; }
+
+    size_t vertexCount() const { return static_cast<size_t>(header.vertexCount); }
+    size_t indexCount() const { return static_cast<size_t>(header.indexCount); }
+    unsigned int stride() const { return header.stride; }
+    // byte offset of the indices in data(), the vertices start at 0
+    size_t indexOffset() const { return static_cast<size_t>(header.indexOffset); }
+    GLenum indexType() const { return header.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+
+private:
+    // 64 bytes so the vertex data after it stays aligned in the mapped file
+    struct Header
+    {
+        static const uint32_t currentVersion = 2;
+        char magic[8] = { 'L', 'O', 'G', 'L', 'M', 'E', 'S', 'H' };
+        uint32_t version = currentVersion;
+        uint32_t stride = 0;
+        uint64_t key = 0;
+        uint64_t vertexCount = 0;
+        uint64_t indexCount = 0;
+        uint64_t indexOffset = 0;
+        uint32_t indexSize = 4;
+        uint32_t padding[3] = {};
+    };
+    static_assert(sizeof(Header) == 64, "mesh cache header has to stay 64 bytes");
+
+    Header header;
+    std::vector<unsigned char> owned;
+    MappedFile mapped;
+};
+
+// identifies the version of the model file and the format a cache was made for
+inline uint64_t meshCacheKey(const std::string& path, const VertexFormat& format)
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](uint64_t value)
+    {
+        for (int i = 0; i < 8; i++)
+            hash = (hash ^ ((value >> (i * 8)) & 0xFF)) * 1099511628211ull;
+    };
+    // same test as the shader file watcher, modification time and size
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0)
+    {
+        mix(static_cast<uint64_t>(info.st_mtime));
+        mix(static_cast<uint64_t>(info.st_size));
+    }
+    for (const VertexFormat::Attribute& attribute : format.getAttributes())
+    {
+        mix(attribute.location);
+        mix(attribute.components);
+        mix(attribute.type);
+        mix(attribute.normalized);
+        mix(attribute.offset);
+    }
+    return hash;
+}
+
+// Loads a model through a binary cache next to it (path + ".cache"). The first run parses the
+// file, runs MeshOptimizer over it and writes the packed mesh, later runs map the cache and
+// skip all of that. The cache is rebuilt when the model file or the vertex format changes.
+// ------------------------------------------------------------------------
+inline PackedMesh loadMesh(const std::string& path, const VertexFormat& format, JobSystem& jobs = JobSystem::shared())
+{
+    std::string cachePath = path + ".cache";
+    uint64_t key = meshCacheKey(path, format);
+    PackedMesh cached = PackedMesh::open(cachePath, key);
+    if (!cached.empty())
+        return cached;
+
+    Mesh mesh = MeshLoader::load(path, jobs);
+    if (mesh.empty())
+    {
+        std::cout << "ERROR::MESH::NOTHING_LOADED: " << path << std::endl;
+        return PackedMesh();
+    }
+    MeshOptimizer::optimize(mesh);
+    PackedMesh packed = PackedMesh::pack(mesh, format);
+    packed.save(cachePath, key);
+    return packed;
+}
+
+#endif
@@ -0,0 +1,1096 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Attribute locations the shaders use for each part of a mesh, VertexShader.txt has the same
+enum MeshAttribute : unsigned int
+{
+    MeshPosition = 0,
+    MeshColor = 1,
+    MeshTexCoord = 2,
+    MeshNormal = 3
+};
+
+// Indexed triangle mesh with one float array per attribute, the way VertexFormat::pack takes
+// them. Optional attributes are empty when the file doesn't have them.
+struct Mesh
+{
+    std::vector<float> positions;   // 3 per vertex
+    std::vector<float> normals;     // 3 per vertex
+    std::vector<float> texCoords;   // 2 per vertex
+    std::vector<float> colors;      // 3 per vertex
+    std::vector<uint32_t> indices;
+
+    size_t vertexCount() const { return positions.size() / 3; }
+    bool empty() const { return indices.empty(); }
+
+    // adds other's triangles after ours. Attributes only one of them has get filled in
+    // ------------------------------------------------------------------------
+    void append(const Mesh& other)
+    {
+        size_t count = vertexCount();
+        size_t otherCount = other.vertexCount();
+        appendAttribute(normals, count, other.normals, otherCount, 3, 0.0f);
+        appendAttribute(texCoords, count, other.texCoords, otherCount, 2, 0.0f);
+        appendAttribute(colors, count, other.colors, otherCount, 3, 1.0f);
+        positions.insert(positions.end(), other.positions.begin(), other.positions.end());
+        for (uint32_t index : other.indices)
+            indices.push_back(static_cast<uint32_t>(count) + index);
+    }
+
+private:
+    static void appendAttribute(std::vector<float>& into, size_t count, const std::vector<float>& from,
+        size_t fromCount, int components, float fill)
+    {
+        if (into.empty() && from.empty())
+            return;
+        into.resize(count * components, fill);
+        if (from.empty())
+            into.resize((count + fromCount) * components, fill);
+        else
+            into.insert(into.end(), from.begin(), from.end());
+    }
+};
+
+namespace mesh_loader_detail
+{
+    inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+    inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+    inline int hexDigit(char c)
+    {
+        if (isDigit(c)) return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    inline const char* skipSpaces(const char* p, const char* end)
+    {
+        while (p < end && isSpace(*p))
+            p++;
+        return p;
+    }
+
+    // strtod is locale dependent and far too slow for files with millions of numbers, and takes
+    // inf, nan and hex floats no mesh file has. This gathers up to 19 digits into an integer
+    // and scales once, which is within an ulp or so
+    // ------------------------------------------------------------------------
+    inline const char* parseDouble(const char* p, const char* end, double& out)
+    {
+        static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+        p = skipSpaces(p, end);
+        bool negative = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+'))
+            p++;
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        bool any = false;
+        for (; p < end && isDigit(*p); p++, any = true)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+            }
+            else
+                exponent++;
+        }
+        if (p < end && *p == '.')
+        {
+            for (p++; p < end && isDigit(*p); p++, any = true)
+            {
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    digits += mantissa != 0;
+                    exponent--;
+                }
+            }
+        }
+        if (!any)
+            return nullptr;
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            p++;
+            bool negativeExponent = p < end && *p == '-';
+            if (p < end && (*p == '-' || *p == '+'))
+                p++;
+            int value = 0;
+            for (; p < end && isDigit(*p); p++)
+                value = std::min(value * 10 + (*p - '0'), 10000);
+            exponent += negativeExponent ? -value : value;
+        }
+        double result = static_cast<double>(mantissa);
+        if (exponent != 0)
+        {
+            int magnitude = exponent < 0 ? -exponent : exponent;
+            double scale = magnitude <= 22 ? powers[magnitude] : std::pow(10.0, magnitude);
+            result = exponent < 0 ? result / scale : result * scale;
+        }
+        out = negative ? -result : result;
+        return p;
+    }
+
+    inline const char* parseFloat(const char* p, const char* end, float& out)
+    {
+        double value;
+        p = parseDouble(p, end, value);
+        out = static_cast<float>(value);
+        return p;
+    }
+
+    inline const char* parseInt(const char* p, const char* end, int& out)
+    {
+        bool negative = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+'))
+            p++;
+        if (p >= end || !isDigit(*p))
+            return nullptr;
+        long long value = 0;
+        for (; p < end && isDigit(*p); p++)
+            value = std::min(value * 10 + (*p - '0'), 0x7FFFFFFFll);
+        out = static_cast<int>(negative ? -value : value);
+        return p;
+    }
+
+    inline bool readFile(const std::string& path, std::vector<char>& data)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+            return false;
+        data.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        return data.empty() || static_cast<bool>(file.read(data.data(), data.size()));
+    }
+
+    inline std::string directoryOf(const std::string& path)
+    {
+        size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+    }
+
+    // Just enough JSON for glTF
+    struct JsonValue
+    {
+        enum Type { Null, Bool, Number, String, Array, Object };
+        Type type = Null;
+        bool boolean = false;
+        double number = 0.0;
+        std::string string;
+        std::vector<JsonValue> array;
+        std::vector<std::pair<std::string, JsonValue>> object;
+
+        // missing keys and indices give a Null value so lookups can be chained
+        const JsonValue& operator[](const char* key) const
+        {
+            for (auto& member : object)
+                if (member.first == key)
+                    return member.second;
+            return null();
+        }
+        const JsonValue& operator[](size_t index) const
+        {
+            return index < array.size() ? array[index] : null();
+        }
+        // without this a literal 0 could also be a null const char*
+        const JsonValue& operator[](int index) const
+        {
+            return index >= 0 ? (*this)[static_cast<size_t>(index)] : null();
+        }
+        size_t size() const { return type == Array ? array.size() : object.size(); }
+        bool isNull() const { return type == Null; }
+        int asInt(int fallback = -1) const { return type == Number ? static_cast<int>(number) : fallback; }
+        float asFloat(float fallback = 0.0f) const { return type == Number ? static_cast<float>(number) : fallback; }
+
+        static const JsonValue& null()
+        {
+            static const JsonValue value;
+            return value;
+        }
+    };
+
+    class JsonParser
+    {
+    public:
+        JsonParser(const char* begin, const char* end) : p(begin), end(end) {}
+
+        bool parse(JsonValue& value)
+        {
+            return parseValue(value, 0) && (skip(), p == end);
+        }
+
+    private:
+        const char* p;
+        const char* end;
+
+        void skip()
+        {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+                p++;
+        }
+
+        bool literal(const char* word)
+        {
+            size_t length = std::strlen(word);
+            if (static_cast<size_t>(end - p) < length || std::strncmp(p, word, length) != 0)
+                return false;
+            p += length;
+            return true;
+        }
+
+        bool parseValue(JsonValue& value, int depth)
+        {
+            skip();
+            if (p >= end || depth > 64)
+                return false;
+            switch (*p)
+            {
+            case '{': return parseObject(value, depth);
+            case '[': return parseArray(value, depth);
+            case '"': value.type = JsonValue::String; return parseString(value.string);
+            case 't': value.type = JsonValue::Bool; value.boolean = true; return literal("true");
+            case 'f': value.type = JsonValue::Bool; return literal("false");
+            case 'n': return literal("null");
+            default:
+            {
+                value.type = JsonValue::Number;
+                p = parseDouble(p, end, value.number);
+                return p != nullptr;
+            }
+            }
+        }
+
+        bool parseObject(JsonValue& value, int depth)
+        {
+            value.type = JsonValue::Object;
+            p++;
+            skip();
+            if (p < end && *p == '}')
+                return ++p, true;
+            while (true)
+            {
+                std::pair<std::string, JsonValue> member;
+                skip();
+                if (p >= end || *p != '"' || !parseString(member.first))
+                    return false;
+                skip();
+                if (p >= end || *p++ != ':' || !parseValue(member.second, depth + 1))
+                    return false;
+                value.object.push_back(std::move(member));
+                skip();
+                if (p < end && *p == ',')
+                {
+                    p++;
+                    continue;
+                }
+                return p < end && *p++ == '}';
+            }
+        }
+
+        bool parseArray(JsonValue& value, int depth)
+        {
+            value.type = JsonValue::Array;
+            p++;
+            skip();
+            if (p < end && *p == ']')
+                return ++p, true;
+            while (true)
+            {
+                value.array.emplace_back();
+                if (!parseValue(value.array.back(), depth + 1))
+                    return false;
+                skip();
+                if (p < end && *p == ',')
+                {
+                    p++;
+                    continue;
+                }
+                return p < end && *p++ == ']';
+            }
+        }
+
+        bool parseString(std::string& out)
+        {
+            p++;
+            while (p < end && *p != '"')
+            {
+                char c = *p++;
+                if (c != '\\')
+                {
+                    out += c;
+                    continue;
+                }
+                if (p >= end)
+                    return false;
+                char escaped = *p++;
+                switch (escaped)
+                {
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u':
+                {
+                    if (end - p < 4)
+                        return false;
+                    unsigned int code = 0;
+                    for (const char* digitsEnd = p + 4; p < digitsEnd; p++)
+                    {
+                        int digit = hexDigit(*p);
+                        if (digit < 0)
+                            return false;
+                        code = code * 16 + digit;
+                    }
+                    // UTF-8, surrogate pairs are rare enough in glTF names to not bother
+                    if (code < 0x80)
+                        out += static_cast<char>(code);
+                    else if (code < 0x800)
+                    {
+                        out += static_cast<char>(0xC0 | (code >> 6));
+                        out += static_cast<char>(0x80 | (code & 0x3F));
+                    }
+                    else
+                    {
+                        out += static_cast<char>(0xE0 | (code >> 12));
+                        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                        out += static_cast<char>(0x80 | (code & 0x3F));
+                    }
+                    break;
+                }
+                default: out += escaped; break;
+                }
+            }
+            return p < end && *p++ == '"';
+        }
+    };
+
+    inline std::vector<unsigned char> decodeBase64(const std::string& text)
+    {
+        std::vector<unsigned char> result;
+        unsigned int bits = 0;
+        int count = 0;
+        for (char c : text)
+        {
+            int value;
+            if (c >= 'A' && c <= 'Z') value = c - 'A';
+            else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+            else if (c >= '0' && c <= '9') value = c - '0' + 52;
+            else if (c == '+' || c == '-') value = 62;
+            else if (c == '/' || c == '_') value = 63;
+            else continue;
+            bits = (bits << 6) | value;
+            count += 6;
+            if (count >= 8)
+            {
+                count -= 8;
+                result.push_back(static_cast<unsigned char>(bits >> count));
+            }
+        }
+        return result;
+    }
+
+    // column major 4x4 matrices for glTF node transforms
+    struct Matrix4
+    {
+        float m[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+        Matrix4 operator*(const Matrix4& b) const
+        {
+            Matrix4 result;
+            for (int column = 0; column < 4; column++)
+                for (int row = 0; row < 4; row++)
+                {
+                    float sum = 0.0f;
+                    for (int k = 0; k < 4; k++)
+                        sum += m[k * 4 + row] * b.m[column * 4 + k];
+                    result.m[column * 4 + row] = sum;
+                }
+            return result;
+        }
+    };
+}
+
+// Reads OBJ and glTF 2.0 (.gltf with .bin or embedded buffers, and .glb) files into a Mesh.
+//
+// OBJ files are cut into line aligned chunks parsed on the job system, then the v/vt/vn
+// triples of the faces are turned into vertices through a hash map so every distinct triple
+// is one vertex. Polygons are triangulated as fans. "v x y z r g b" vertex colors are read.
+//
+// glTF primitives are decoded in parallel with the node transforms of the default scene
+// applied, then welded: vertices with identical attributes are merged through a hash map.
+// Only triangle lists are supported, sparse accessors and morph targets are ignored.
+class MeshLoader
+{
+public:
+    // picks the parser from the extension
+    // ------------------------------------------------------------------------
+    static Mesh load(const std::string& path, JobSystem& jobs = JobSystem::shared())
+    {
+        std::string extension = path.substr(path.find_last_of('.') + 1);
+        for (char& c : extension)
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        if (extension == "obj")
+            return loadObj(path, jobs);
+        if (extension == "gltf" || extension == "glb")
+            return loadGltf(path, jobs);
+        std::cout << "ERROR::MESH::UNKNOWN_FORMAT: " << path << std::endl;
+        return Mesh();
+    }
+
+    // ------------------------------------------------------------------------
+    static Mesh loadObj(const std::string& path, JobSystem& jobs = JobSystem::shared())
+    {
+        std::vector<char> text;
+        if (!mesh_loader_detail::readFile(path, text))
+        {
+            std::cout << "ERROR::MESH::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+            return Mesh();
+        }
+
+        // chunks of at least 1 MB that end on a line break
+        const size_t chunkSize = std::max<size_t>(text.size() / (jobs.threadCount() * 4 + 1), 1 << 20);
+        std::vector<size_t> starts(1, 0);
+        while (starts.back() + chunkSize < text.size())
+        {
+            const char* newline = static_cast<const char*>(std::memchr(text.data() + starts.back() + chunkSize, '\n', text.size() - starts.back() - chunkSize));
+            if (!newline)
+                break;
+            starts.push_back(newline - text.data() + 1);
+        }
+        starts.push_back(text.size());
+
+        std::vector<ObjChunk> chunks(starts.size() - 1);
+        jobs.parallelFor(chunks.size(), 1, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+                parseObjChunk(text.data() + starts[i], text.data() + starts[i + 1], chunks[i]);
+        });
+
+        // negative indices count back from the last element defined before the face, the
+        // chunks only knew their own counts so add everything before them
+        size_t counts[3] = {};
+        bool hasColors = false;
+        std::vector<size_t> firsts(chunks.size() * 3);
+        for (size_t i = 0; i < chunks.size(); i++)
+        {
+            firsts[i * 3 + 0] = counts[0];
+            firsts[i * 3 + 1] = counts[1];
+            firsts[i * 3 + 2] = counts[2];
+            counts[0] += chunks[i].positions.size() / 3;
+            counts[1] += chunks[i].texCoords.size() / 2;
+            counts[2] += chunks[i].normals.size() / 3;
+            hasColors = hasColors || chunks[i].hasColors;
+        }
+        jobs.parallelFor(chunks.size(), 1, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+                for (ObjCorner& corner : chunks[i].corners)
+                    for (int k = 0; k < 3; k++)
+                        if (corner.relative & (1 << k))
+                            corner.index[k] += static_cast<int>(firsts[i * 3 + k]);
+        });
+
+        std::vector<float> positions, texCoords, normals, colors;
+        positions.reserve(counts[0] * 3);
+        texCoords.reserve(counts[1] * 2);
+        normals.reserve(counts[2] * 3);
+        for (ObjChunk& chunk : chunks)
+        {
+            positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+            texCoords.insert(texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+            normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+            if (hasColors)
+                colors.insert(colors.end(), chunk.colors.begin(), chunk.colors.end());
+        }
+
+        size_t cornerCount = 0;
+        bool anyTexCoords = false, anyNormals = false;
+        for (ObjChunk& chunk : chunks)
+        {
+            cornerCount += chunk.corners.size();
+            anyTexCoords = anyTexCoords || chunk.anyTexCoords;
+            anyNormals = anyNormals || chunk.anyNormals;
+        }
+
+        // one vertex per distinct position/texcoord/normal triple
+        Mesh mesh;
+        mesh.indices.reserve(cornerCount);
+        std::unordered_map<ObjKey, uint32_t, ObjKeyHash> vertices;
+        vertices.reserve(cornerCount / 2);
+        bool outOfRange = false;
+        for (ObjChunk& chunk : chunks)
+        {
+            for (const ObjCorner& corner : chunk.corners)
+            {
+                ObjKey key = { corner.index[0], corner.index[1], corner.index[2] };
+                if (key.position < 0 || static_cast<size_t>(key.position) >= counts[0] || key.texCoord < -1 ||
+                    key.texCoord >= static_cast<int>(counts[1]) || key.normal < -1 || key.normal >= static_cast<int>(counts[2]))
+                {
+                    outOfRange = true;
+                    key = { 0, -1, -1 };
+                    if (counts[0] == 0)
+                        continue;
+                }
+                auto inserted = vertices.emplace(key, static_cast<uint32_t>(mesh.vertexCount()));
+                if (inserted.second)
+                {
+                    const float* position = &positions[key.position * 3];
+                    mesh.positions.insert(mesh.positions.end(), position, position + 3);
+                    if (hasColors)
+                        mesh.colors.insert(mesh.colors.end(), &colors[key.position * 3], &colors[key.position * 3] + 3);
+                    if (anyTexCoords)
+                    {
+                        mesh.texCoords.push_back(key.texCoord >= 0 ? texCoords[key.texCoord * 2] : 0.0f);
+                        mesh.texCoords.push_back(key.texCoord >= 0 ? texCoords[key.texCoord * 2 + 1] : 0.0f);
+                    }
+                    if (anyNormals)
+                        for (int k = 0; k < 3; k++)
+                            mesh.normals.push_back(key.normal >= 0 ? normals[key.normal * 3 + k] : 0.0f);
+                }
+                mesh.indices.push_back(inserted.first->second);
+            }
+        }
+        if (outOfRange)
+            std::cout << "ERROR::MESH::INDEX_OUT_OF_RANGE: " << path << std::endl;
+        return mesh;
+    }
+
+    // ------------------------------------------------------------------------
+    static Mesh loadGltf(const std::string& path, JobSystem& jobs = JobSystem::shared())
+    {
+        using namespace mesh_loader_detail;
+        std::vector<char> file;
+        if (!readFile(path, file))
+        {
+            std::cout << "ERROR::MESH::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+            return Mesh();
+        }
+
+        // .glb is a 12 byte header followed by a JSON chunk and an optional binary chunk
+        const char* jsonBegin = file.data();
+        const char* jsonEnd = file.data() + file.size();
+        std::vector<unsigned char> glbBuffer;
+        if (file.size() >= 20 && std::memcmp(file.data(), "glTF", 4) == 0)
+        {
+            size_t offset = 12;
+            jsonBegin = jsonEnd = nullptr;
+            while (offset + 8 <= file.size())
+            {
+                uint32_t length, type;
+                std::memcpy(&length, &file[offset], 4);
+                std::memcpy(&type, &file[offset + 4], 4);
+                if (offset + 8 + length > file.size())
+                    break;
+                const char* chunk = file.data() + offset + 8;
+                if (type == 0x4E4F534A)
+                {
+                    jsonBegin = chunk;
+                    jsonEnd = chunk + length;
+                }
+                else if (type == 0x004E4942)
+                    glbBuffer.assign(chunk, chunk + length);
+                offset += 8 + ((length + 3) & ~3u);
+            }
+        }
+
+        JsonValue gltf;
+        if (!jsonBegin || !JsonParser(jsonBegin, jsonEnd).parse(gltf))
+        {
+            std::cout << "ERROR::MESH::BAD_GLTF: " << path << std::endl;
+            return Mesh();
+        }
+
+        std::vector<std::vector<unsigned char>> buffers;
+        const JsonValue& bufferList = gltf["buffers"];
+        for (size_t i = 0; i < bufferList.size(); i++)
+        {
+            const JsonValue& uri = bufferList[i]["uri"];
+            std::vector<unsigned char> data;
+            if (uri.isNull())
+                data = glbBuffer;
+            else if (uri.string.compare(0, 5, "data:") == 0)
+                data = decodeBase64(uri.string.substr(uri.string.find(',') + 1));
+            else
+            {
+                std::vector<char> bytes;
+                if (!readFile(directoryOf(path) + uri.string, bytes))
+                    std::cout << "ERROR::MESH::FILE_NOT_SUCCESSFULLY_READ: " << directoryOf(path) + uri.string << std::endl;
+                data.assign(bytes.begin(), bytes.end());
+            }
+            buffers.push_back(std::move(data));
+        }
+
+        // every primitive the scene draws, with the world matrix of the node drawing it
+        std::vector<GltfInstance> instances;
+        const JsonValue& scenes = gltf["scenes"];
+        if (scenes.size() > 0)
+        {
+            const JsonValue& roots = scenes[std::max(gltf["scene"].asInt(0), 0)]["nodes"];
+            for (size_t i = 0; i < roots.size(); i++)
+                collectNode(gltf, roots[i].asInt(), Matrix4(), instances, 0);
+        }
+        else
+        {
+            for (size_t i = 0; i < gltf["meshes"].size(); i++)
+                addMeshInstances(gltf, static_cast<int>(i), Matrix4(), instances);
+        }
+
+        std::vector<Mesh> parts(instances.size());
+        jobs.parallelFor(instances.size(), 1, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+                parts[i] = decodePrimitive(gltf, buffers, instances[i]);
+        });
+
+        Mesh mesh;
+        for (const Mesh& part : parts)
+            mesh.append(part);
+        return weld(mesh);
+    }
+
+    // merges vertices whose attributes are all bit for bit the same
+    // ------------------------------------------------------------------------
+    static Mesh weld(const Mesh& mesh)
+    {
+        VertexHash hash = { &mesh };
+        VertexEqual equal = { &mesh };
+        std::unordered_map<uint32_t, uint32_t, VertexHash, VertexEqual> unique(mesh.vertexCount(), hash, equal);
+        std::vector<uint32_t> remap(mesh.vertexCount());
+        Mesh result;
+        for (uint32_t i = 0; i < mesh.vertexCount(); i++)
+        {
+            auto inserted = unique.emplace(i, static_cast<uint32_t>(result.vertexCount()));
+            remap[i] = inserted.first->second;
+            if (!inserted.second)
+                continue;
+            copyVertex(mesh.positions, i, 3, result.positions);
+            copyVertex(mesh.normals, i, 3, result.normals);
+            copyVertex(mesh.texCoords, i, 2, result.texCoords);
+            copyVertex(mesh.colors, i, 3, result.colors);
+        }
+        result.indices.reserve(mesh.indices.size());
+        for (uint32_t index : mesh.indices)
+            result.indices.push_back(remap[index]);
+        return result;
+    }
+
+private:
+    // one face corner, indices are 0 based and -1 when missing. Bit k of relative is set when
+    // index[k] was negative in the file and still needs the counts of earlier chunks added
+    struct ObjCorner
+    {
+        int index[3];
+        unsigned char relative;
+    };
+
+    struct ObjChunk
+    {
+        std::vector<float> positions, colors, texCoords, normals;
+        std::vector<ObjCorner> corners;
+        bool hasColors = false, anyTexCoords = false, anyNormals = false;
+    };
+
+    struct ObjKey
+    {
+        int position, texCoord, normal;
+        bool operator==(const ObjKey& other) const
+        {
+            return position == other.position && texCoord == other.texCoord && normal == other.normal;
+        }
+    };
+
+    struct ObjKeyHash
+    {
+        size_t operator()(const ObjKey& key) const
+        {
+            uint64_t hash = static_cast<uint32_t>(key.position) * 0x9E3779B97F4A7C15ull;
+            hash ^= (static_cast<uint32_t>(key.texCoord) + 0x632BE59BD9B4E019ull + (hash << 6) + (hash >> 2));
+            hash ^= (static_cast<uint32_t>(key.normal) + 0x85EBCA77C2B2AE63ull + (hash << 6) + (hash >> 2));
+            return static_cast<size_t>(hash ^ (hash >> 29));
+        }
+    };
+
+    struct VertexHash
+    {
+        const Mesh* mesh;
+        size_t operator()(uint32_t vertex) const
+        {
+            uint64_t hash = 14695981039346656037ull;
+            auto mix = [&](const std::vector<float>& values, int components)
+            {
+                for (int k = 0; k < components && !values.empty(); k++)
+                {
+                    uint32_t bits;
+                    std::memcpy(&bits, &values[vertex * components + k], 4);
+                    hash = (hash ^ bits) * 1099511628211ull;
+                }
+            };
+            mix(mesh->positions, 3);
+            mix(mesh->normals, 3);
+            mix(mesh->texCoords, 2);
+            mix(mesh->colors, 3);
+            return static_cast<size_t>(hash ^ (hash >> 32));
+        }
+    };
+
+    struct VertexEqual
+    {
+        const Mesh* mesh;
+        bool operator()(uint32_t a, uint32_t b) const
+        {
+            auto same = [&](const std::vector<float>& values, int components)
+            {
+                return values.empty() || std::memcmp(&values[a * components], &values[b * components], components * sizeof(float)) == 0;
+            };
+            return same(mesh->positions, 3) && same(mesh->normals, 3) && same(mesh->texCoords, 2) && same(mesh->colors, 3);
+        }
+    };
+
+    struct GltfInstance
+    {
+        int mesh;
+        int primitive;
+        mesh_loader_detail::Matrix4 world;
+    };
+
+    static void copyVertex(const std::vector<float>& from, uint32_t vertex, int components, std::vector<float>& into)
+    {
+        if (!from.empty())
+            into.insert(into.end(), from.begin() + vertex * components, from.begin() + (vertex + 1) * components);
+    }
+
+    // ------------------------------------------------------------------------
+    static void parseObjChunk(const char* p, const char* end, ObjChunk& chunk)
+    {
+        using namespace mesh_loader_detail;
+        std::vector<ObjCorner> polygon;
+        while (p < end)
+        {
+            const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            if (!lineEnd)
+                lineEnd = end;
+            const char* q = skipSpaces(p, lineEnd);
+            p = lineEnd + 1;
+            const char* keywordEnd = q;
+            while (keywordEnd < lineEnd && !isSpace(*keywordEnd))
+                keywordEnd++;
+            std::string keyword(q, keywordEnd);
+
+            float values[6];
+            int count = 0;
+            if (keyword == "v" || keyword == "vt" || keyword == "vn")
+            {
+                int wanted = keyword == "vt" ? 2 : (keyword == "vn" ? 3 : 6);
+                const char* r = keywordEnd;
+                while (count < wanted && (r = parseFloat(r, lineEnd, values[count])) != nullptr)
+                    count++;
+                if (keyword == "vt")
+                {
+                    values[1] = count > 1 ? values[1] : 0.0f;
+                    chunk.texCoords.insert(chunk.texCoords.end(), values, values + 2);
+                }
+                else if (keyword == "vn")
+                {
+                    for (int k = count; k < 3; k++)
+                        values[k] = 0.0f;
+                    chunk.normals.insert(chunk.normals.end(), values, values + 3);
+                }
+                else
+                {
+                    for (int k = count; k < 3; k++)
+                        values[k] = 0.0f;
+                    chunk.positions.insert(chunk.positions.end(), values, values + 3);
+                    bool colored = count == 6;
+                    chunk.hasColors = chunk.hasColors || colored;
+                    chunk.colors.push_back(colored ? values[3] : 1.0f);
+                    chunk.colors.push_back(colored ? values[4] : 1.0f);
+                    chunk.colors.push_back(colored ? values[5] : 1.0f);
+                }
+            }
+            else if (keyword == "f")
+            {
+                polygon.clear();
+                const char* r = keywordEnd;
+                while (true)
+                {
+                    r = skipSpaces(r, lineEnd);
+                    if (r >= lineEnd)
+                        break;
+                    ObjCorner corner = { { -1, -1, -1 }, 0 };
+                    const int localCounts[3] = { static_cast<int>(chunk.positions.size() / 3),
+                        static_cast<int>(chunk.texCoords.size() / 2), static_cast<int>(chunk.normals.size() / 3) };
+                    for (int k = 0; k < 3; k++)
+                    {
+                        int value;
+                        const char* next = parseInt(r, lineEnd, value);
+                        if (next)
+                        {
+                            r = next;
+                            if (value < 0)
+                            {
+                                corner.index[k] = localCounts[k] + value;
+                                corner.relative |= 1 << k;
+                            }
+                            else
+                                corner.index[k] = value - 1;
+                        }
+                        if (r >= lineEnd || *r != '/')
+                            break;
+                        r++;
+                    }
+                    // skip anything the face parser doesn't understand
+                    while (r < lineEnd && !isSpace(*r))
+                        r++;
+                    chunk.anyTexCoords = chunk.anyTexCoords || corner.index[1] != -1;
+                    chunk.anyNormals = chunk.anyNormals || corner.index[2] != -1;
+                    polygon.push_back(corner);
+                }
+                for (size_t k = 2; k < polygon.size(); k++)
+                {
+                    chunk.corners.push_back(polygon[0]);
+                    chunk.corners.push_back(polygon[k - 1]);
+                    chunk.corners.push_back(polygon[k]);
+                }
+            }
+        }
+    }
+
+    static void collectNode(const mesh_loader_detail::JsonValue& gltf, int index, const mesh_loader_detail::Matrix4& parent,
+        std::vector<GltfInstance>& instances, int depth)
+    {
+        using namespace mesh_loader_detail;
+        const JsonValue& node = gltf["nodes"][index];
+        if (node.isNull() || depth > 64)
+            return;
+
+        Matrix4 local;
+        const JsonValue& matrix = node["matrix"];
+        if (matrix.size() == 16)
+        {
+            for (int i = 0; i < 16; i++)
+                local.m[i] = matrix[i].asFloat();
+        }
+        else
+        {
+            // T * R * S
+            const JsonValue& t = node["translation"];
+            const JsonValue& r = node["rotation"];
+            const JsonValue& s = node["scale"];
+            float x = r[0].asFloat(0.0f), y = r[1].asFloat(0.0f), z = r[2].asFloat(0.0f), w = r[3].asFloat(1.0f);
+            float rotation[9] = {
+                1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w),
+                2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w),
+                2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y) };
+            for (int column = 0; column < 3; column++)
+                for (int row = 0; row < 3; row++)
+                    local.m[column * 4 + row] = rotation[column * 3 + row] * s[column].asFloat(1.0f);
+            for (int row = 0; row < 3; row++)
+                local.m[12 + row] = t[row].asFloat(0.0f);
+        }
+        Matrix4 world = parent * local;
+
+        if (node["mesh"].asInt() >= 0)
+            addMeshInstances(gltf, node["mesh"].asInt(), world, instances);
+        const JsonValue& children = node["children"];
+        for (size_t i = 0; i < children.size(); i++)
+            collectNode(gltf, children[i].asInt(), world, instances, depth + 1);
+    }
+
+    static void addMeshInstances(const mesh_loader_detail::JsonValue& gltf, int mesh, const mesh_loader_detail::Matrix4& world,
+        std::vector<GltfInstance>& instances)
+    {
+        const mesh_loader_detail::JsonValue& primitives = gltf["meshes"][mesh]["primitives"];
+        for (size_t i = 0; i < primitives.size(); i++)
+        {
+            int mode = primitives[i]["mode"].asInt(4);
+            if (mode != 4)
+            {
+                std::cout << "ERROR::MESH::UNSUPPORTED_PRIMITIVE_MODE: " << mode << std::endl;
+                continue;
+            }
+            instances.push_back({ mesh, static_cast<int>(i), world });
+        }
+    }
+
+    // where the elements of an accessor are, false when it doesn't fit in its buffer
+    // ------------------------------------------------------------------------
+    struct AccessorData
+    {
+        const unsigned char* data;
+        size_t count;
+        size_t stride;
+        int components;
+        int componentType;
+        bool normalized;
+    };
+
+    static bool findAccessor(const mesh_loader_detail::JsonValue& gltf, const std::vector<std::vector<unsigned char>>& buffers,
+        int index, AccessorData& result)
+    {
+        using namespace mesh_loader_detail;
+        const JsonValue& accessor = gltf["accessors"][index];
+        const JsonValue& view = gltf["bufferViews"][accessor["bufferView"].asInt()];
+        if (accessor.isNull() || view.isNull())
+            return false;
+        const std::string& type = accessor["type"].string;
+        result.components = type == "SCALAR" ? 1 : (type == "VEC2" ? 2 : (type == "VEC3" ? 3 : (type == "VEC4" ? 4 : 0)));
+        result.componentType = accessor["componentType"].asInt();
+        int componentSize = result.componentType == 5126 || result.componentType == 5125 ? 4 :
+            (result.componentType == 5122 || result.componentType == 5123 ? 2 : 1);
+        result.count = static_cast<size_t>(accessor["count"].asInt(0));
+        result.stride = view["byteStride"].asInt(0) > 0 ? view["byteStride"].asInt() : result.components * componentSize;
+        result.normalized = accessor["normalized"].type == JsonValue::Bool && accessor["normalized"].boolean;
+        size_t offset = static_cast<size_t>(view["byteOffset"].asInt(0)) + accessor["byteOffset"].asInt(0);
+        size_t bufferIndex = static_cast<size_t>(view["buffer"].asInt(0));
+        if (result.components == 0 || bufferIndex >= buffers.size() ||
+            (result.count > 0 && offset + (result.count - 1) * result.stride + result.components * componentSize > buffers[bufferIndex].size()))
+        {
+            std::cout << "ERROR::MESH::BAD_ACCESSOR: " << index << std::endl;
+            return false;
+        }
+        result.data = buffers[bufferIndex].data() + offset;
+        return true;
+    }
+
+    // reads an accessor as components floats per element, converting normalized integers
+    // ------------------------------------------------------------------------
+    static bool readAccessor(const mesh_loader_detail::JsonValue& gltf, const std::vector<std::vector<unsigned char>>& buffers,
+        int index, int components, std::vector<float>& out)
+    {
+        AccessorData accessor;
+        if (!findAccessor(gltf, buffers, index, accessor))
+            return false;
+        bool normalized = accessor.normalized;
+        out.assign(accessor.count * components, 0.0f);
+        for (size_t i = 0; i < accessor.count; i++)
+        {
+            const unsigned char* element = accessor.data + i * accessor.stride;
+            for (int k = 0; k < std::min(components, accessor.components); k++)
+            {
+                float value;
+                switch (accessor.componentType)
+                {
+                case 5126: std::memcpy(&value, element + k * 4, 4); break;
+                case 5121: value = element[k] / (normalized ? 255.0f : 1.0f); break;
+                case 5120: value = std::max(static_cast<signed char>(element[k]) / (normalized ? 127.0f : 1.0f), -1.0f); break;
+                case 5123: { uint16_t v; std::memcpy(&v, element + k * 2, 2); value = v / (normalized ? 65535.0f : 1.0f); break; }
+                case 5122: { int16_t v; std::memcpy(&v, element + k * 2, 2); value = std::max(v / (normalized ? 32767.0f : 1.0f), -1.0f); break; }
+                default: { uint32_t v; std::memcpy(&v, element + k * 4, 4); value = static_cast<float>(v); break; }
+                }
+                out[i * components + k] = value;
+            }
+        }
+        return true;
+    }
+
+    // indices stay integers, floats can't hold every 32 bit index
+    // ------------------------------------------------------------------------
+    static bool readIndices(const mesh_loader_detail::JsonValue& gltf, const std::vector<std::vector<unsigned char>>& buffers,
+        int index, std::vector<uint32_t>& out)
+    {
+        AccessorData accessor;
+        if (!findAccessor(gltf, buffers, index, accessor) || accessor.components != 1)
+            return false;
+        out.resize(accessor.count);
+        for (size_t i = 0; i < accessor.count; i++)
+        {
+            const unsigned char* element = accessor.data + i * accessor.stride;
+            switch (accessor.componentType)
+            {
+            case 5121: out[i] = element[0]; break;
+            case 5123: { uint16_t v; std::memcpy(&v, element, 2); out[i] = v; break; }
+            case 5125: std::memcpy(&out[i], element, 4); break;
+            default: return false;
+            }
+        }
+        return true;
+    }
+
+    // ------------------------------------------------------------------------
+    static Mesh decodePrimitive(const mesh_loader_detail::JsonValue& gltf, const std::vector<std::vector<unsigned char>>& buffers,
+        const GltfInstance& instance)
+    {
+        using namespace mesh_loader_detail;
+        const JsonValue& primitive = gltf["meshes"][instance.mesh]["primitives"][instance.primitive];
+        const JsonValue& attributes = primitive["attributes"];
+        Mesh mesh;
+        if (!readAccessor(gltf, buffers, attributes["POSITION"].asInt(), 3, mesh.positions))
+            return Mesh();
+        size_t count = mesh.vertexCount();
+        if (count == 0)
+            return Mesh();
+        if (!attributes["NORMAL"].isNull())
+            readAccessor(gltf, buffers, attributes["NORMAL"].asInt(), 3, mesh.normals);
+        if (!attributes["TEXCOORD_0"].isNull())
+            readAccessor(gltf, buffers, attributes["TEXCOORD_0"].asInt(), 2, mesh.texCoords);
+        if (!attributes["COLOR_0"].isNull())
+            readAccessor(gltf, buffers, attributes["COLOR_0"].asInt(), 3, mesh.colors);
+        // an attribute with the wrong count is dropped instead of read past the end
+        if (mesh.normals.size() != count * 3) mesh.normals.clear();
+        if (mesh.texCoords.size() != count * 2) mesh.texCoords.clear();
+        if (mesh.colors.size() != count * 3) mesh.colors.clear();
+
+        if (!primitive["indices"].isNull() && readIndices(gltf, buffers, primitive["indices"].asInt(), mesh.indices))
+        {
+            for (uint32_t& index : mesh.indices)
+                index = std::min(index, static_cast<uint32_t>(count - 1));
+        }
+        else
+        {
+            for (uint32_t i = 0; i < count; i++)
+                mesh.indices.push_back(i);
+        }
+        mesh.indices.resize(mesh.indices.size() / 3 * 3);
+
+        // positions by the world matrix, normals by its cofactor matrix (the inverse transpose
+        // scaled by the determinant) so non uniform scales keep them perpendicular
+        const float* m = instance.world.m;
+        for (size_t i = 0; i < count; i++)
+        {
+            float* p = &mesh.positions[i * 3];
+            float x = p[0], y = p[1], z = p[2];
+            for (int row = 0; row < 3; row++)
+                p[row] = m[row] * x + m[4 + row] * y + m[8 + row] * z + m[12 + row];
+        }
+        float cofactor[9] = {
+            m[5] * m[10] - m[6] * m[9], m[6] * m[8] - m[4] * m[10], m[4] * m[9] - m[5] * m[8],
+            m[2] * m[9] - m[1] * m[10], m[0] * m[10] - m[2] * m[8], m[1] * m[8] - m[0] * m[9],
+            m[1] * m[6] - m[2] * m[5], m[2] * m[4] - m[0] * m[6], m[0] * m[5] - m[1] * m[4] };
+        for (size_t i = 0; i < mesh.normals.size(); i += 3)
+        {
+            float* n = &mesh.normals[i];
+            float x = n[0], y = n[1], z = n[2];
+            for (int row = 0; row < 3; row++)
+                n[row] = cofactor[row] * x + cofactor[3 + row] * y + cofactor[6 + row] * z;
+            float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if (length > 0.0f)
+                for (int row = 0; row < 3; row++)
+                    n[row] /= length;
+        }
+        // a mirroring transform turns the triangles inside out
+        float determinant = m[0] * cofactor[0] + m[1] * cofactor[1] + m[2] * cofactor[2];
+        if (determinant < 0.0f)
+            for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+                std::swap(mesh.indices[i + 1], mesh.indices[i + 2]);
+        return mesh;
+    }
+};
+
+#endif
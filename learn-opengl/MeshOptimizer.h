@@ -0,0 +1,274 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include "MeshLoader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// How well an index order uses the post transform vertex cache, simulated as a FIFO
+struct VertexCacheStats
+{
+    size_t misses = 0;
+    // average cache misses per triangle, 0.5 is the best a regular grid can do and 3 the worst
+    float acmr = 0.0f;
+    // average transforms per vertex, 1 means every vertex is shaded only once
+    float atvr = 0.0f;
+};
+
+// Reorders the triangles and vertices of indexed meshes so the GPU does less work drawing them:
+//
+// - optimizeVertexCache: Tipsify (Sander, Nehab and Barczak 2007) orders triangles so
+//   vertices are reused while still in the post transform cache, fewer vertex shader runs.
+//   It is linear time, which matters for multi million triangle meshes
+// - optimizeOverdraw: sorts the clusters Tipsify produced so ones facing out of the mesh are
+//   drawn first and hide the ones behind them, fewer fragments shaded
+// - optimizeVertexFetch: renumbers vertices in the order the triangles first use them, so
+//   vertex fetches walk through memory instead of jumping around
+//
+// optimize runs all three in that order.
+class MeshOptimizer
+{
+public:
+    // cache size Tipsify plans for, real caches are about this size or bigger
+    static const int defaultCacheSize = 16;
+
+    // ------------------------------------------------------------------------
+    static void optimize(Mesh& mesh, int cacheSize = defaultCacheSize)
+    {
+        std::vector<uint32_t> clusters;
+        mesh.indices = optimizeVertexCache(mesh.indices, mesh.vertexCount(), cacheSize, &clusters);
+        optimizeOverdraw(mesh.indices, mesh.positions, clusters);
+        optimizeVertexFetch(mesh);
+    }
+
+    // returns the reordered indices. clusters, when given, gets the first triangle of every
+    // run that starts with a cold cache, the points where the order can be changed freely
+    // ------------------------------------------------------------------------
+    static std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount,
+        int cacheSize = defaultCacheSize, std::vector<uint32_t>* clusters = nullptr)
+    {
+        size_t triangleCount = indices.size() / 3;
+        // the triangles using each vertex, and how many of them are still to be emitted
+        std::vector<uint32_t> live(vertexCount, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            live[indices[i]]++;
+        std::vector<uint32_t> offsets(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+            offsets[v + 1] = offsets[v] + live[v];
+        std::vector<uint32_t> adjacency(triangleCount * 3);
+        {
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < triangleCount * 3; i++)
+                adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        // a vertex is in the cache while time - timestamp <= cacheSize
+        std::vector<uint32_t> timestamp(vertexCount, 0);
+        std::vector<char> emitted(triangleCount, 0);
+        std::vector<uint32_t> deadEnd;
+        std::vector<uint32_t> candidates;
+        std::vector<uint32_t> result;
+        result.reserve(triangleCount * 3);
+        deadEnd.reserve(triangleCount * 3);
+        if (clusters)
+            clusters->assign(1, 0);
+
+        uint32_t time = cacheSize + 1;
+        size_t cursor = 0;
+        long long fanning = vertexCount > 0 ? 0 : -1;
+        while (fanning >= 0)
+        {
+            // emit every triangle around the fanning vertex
+            candidates.clear();
+            for (uint32_t k = offsets[fanning]; k < offsets[fanning + 1]; k++)
+            {
+                uint32_t triangle = adjacency[k];
+                if (emitted[triangle])
+                    continue;
+                emitted[triangle] = 1;
+                for (int c = 0; c < 3; c++)
+                {
+                    uint32_t v = indices[triangle * 3 + c];
+                    result.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+                    if (time - timestamp[v] > static_cast<uint32_t>(cacheSize))
+                        timestamp[v] = time++;
+                }
+            }
+
+            // next fanning vertex: the one among the candidates that will still be in the
+            // cache after its remaining triangles are emitted and has been there longest
+            long long best = -1;
+            int bestPriority = -1;
+            for (uint32_t v : candidates)
+            {
+                if (live[v] == 0)
+                    continue;
+                int priority = 0;
+                if (time - timestamp[v] + 2 * live[v] <= static_cast<uint32_t>(cacheSize))
+                    priority = static_cast<int>(time - timestamp[v]);
+                if (priority > bestPriority)
+                {
+                    best = v;
+                    bestPriority = priority;
+                }
+            }
+            if (best < 0)
+            {
+                // stuck, back up to a recently used vertex or failing that any vertex left
+                while (!deadEnd.empty() && best < 0)
+                {
+                    uint32_t v = deadEnd.back();
+                    deadEnd.pop_back();
+                    if (live[v] > 0)
+                        best = v;
+                }
+                while (best < 0 && cursor < vertexCount)
+                {
+                    if (live[cursor] > 0)
+                        best = static_cast<long long>(cursor);
+                    else
+                        cursor++;
+                }
+                if (best >= 0 && clusters && result.size() / 3 != clusters->back())
+                    clusters->push_back(static_cast<uint32_t>(result.size() / 3));
+            }
+            fanning = best;
+        }
+        return result;
+    }
+
+    // Sorts the clusters of a cache optimized order by how much they face away from the
+    // middle of the mesh, outward facing ones first. Clusters under minClusterSize triangles
+    // are merged with the ones after them, each cluster starts with a cold cache after
+    // sorting so tiny ones would throw away what optimizeVertexCache gained
+    // ------------------------------------------------------------------------
+    static void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<float>& positions,
+        const std::vector<uint32_t>& clusters, size_t minClusterSize = 128)
+    {
+        size_t triangleCount = indices.size() / 3;
+        std::vector<uint32_t> starts;
+        for (uint32_t start : clusters)
+            if (start < triangleCount && (starts.empty() || start - starts.back() >= minClusterSize))
+                starts.push_back(start);
+        if (starts.size() < 2)
+            return;
+
+        double center[3] = {};
+        for (size_t i = 0; i < indices.size(); i++)
+            for (int k = 0; k < 3; k++)
+                center[k] += positions[indices[i] * 3 + k];
+        for (int k = 0; k < 3; k++)
+            center[k] /= static_cast<double>(indices.size());
+
+        struct Cluster
+        {
+            uint32_t start;
+            uint32_t end;
+            double potential;
+        };
+        std::vector<Cluster> sorted;
+        for (size_t c = 0; c < starts.size(); c++)
+        {
+            Cluster cluster = { starts[c], c + 1 < starts.size() ? starts[c + 1] : static_cast<uint32_t>(triangleCount), 0.0 };
+            // area weighted centroid and normal, the cross product is already twice the area
+            double centroid[3] = {}, normal[3] = {}, area = 0.0;
+            for (uint32_t t = cluster.start; t < cluster.end; t++)
+            {
+                const float* a = &positions[indices[t * 3] * 3];
+                const float* b = &positions[indices[t * 3 + 1] * 3];
+                const float* d = &positions[indices[t * 3 + 2] * 3];
+                double ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+                double ad[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+                double cross[3] = { ab[1] * ad[2] - ab[2] * ad[1], ab[2] * ad[0] - ab[0] * ad[2], ab[0] * ad[1] - ab[1] * ad[0] };
+                double triangleArea = std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+                for (int k = 0; k < 3; k++)
+                {
+                    centroid[k] += (a[k] + b[k] + d[k]) / 3.0 * triangleArea;
+                    normal[k] += cross[k];
+                }
+                area += triangleArea;
+            }
+            double normalLength = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            if (area > 0.0 && normalLength > 0.0)
+                for (int k = 0; k < 3; k++)
+                    cluster.potential += (centroid[k] / area - center[k]) * normal[k] / normalLength;
+            sorted.push_back(cluster);
+        }
+        std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.potential > b.potential; });
+
+        std::vector<uint32_t> result;
+        result.reserve(indices.size());
+        for (const Cluster& cluster : sorted)
+            result.insert(result.end(), indices.begin() + cluster.start * 3, indices.begin() + cluster.end * 3);
+        indices.swap(result);
+    }
+
+    // renumbers vertices in order of first use and drops vertices no triangle uses
+    // ------------------------------------------------------------------------
+    static void optimizeVertexFetch(Mesh& mesh)
+    {
+        const uint32_t unused = 0xFFFFFFFFu;
+        std::vector<uint32_t> remap(mesh.vertexCount(), unused);
+        uint32_t next = 0;
+        for (uint32_t& index : mesh.indices)
+        {
+            if (remap[index] == unused)
+                remap[index] = next++;
+            index = remap[index];
+        }
+        reorder(mesh.positions, remap, next, 3);
+        reorder(mesh.normals, remap, next, 3);
+        reorder(mesh.texCoords, remap, next, 2);
+        reorder(mesh.colors, remap, next, 3);
+    }
+
+    // ------------------------------------------------------------------------
+    static VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize = defaultCacheSize)
+    {
+        VertexCacheStats stats;
+        std::vector<uint32_t> cachedAt(vertexCount, 0);
+        std::vector<char> used(vertexCount, 0);
+        size_t usedCount = 0;
+        uint32_t time = cacheSize + 1;
+        for (uint32_t index : indices)
+        {
+            if (!used[index])
+            {
+                used[index] = 1;
+                usedCount++;
+            }
+            // FIFO: a hit doesn't move the vertex, it leaves cacheSize misses after it went in
+            if (time - cachedAt[index] > static_cast<uint32_t>(cacheSize))
+            {
+                cachedAt[index] = time++;
+                stats.misses++;
+            }
+        }
+        if (!indices.empty())
+        {
+            stats.acmr = static_cast<float>(stats.misses) / (indices.size() / 3);
+            stats.atvr = static_cast<float>(stats.misses) / usedCount;
+        }
+        return stats;
+    }
+
+private:
+    static void reorder(std::vector<float>& values, const std::vector<uint32_t>& remap, uint32_t count, int components)
+    {
+        if (values.empty())
+            return;
+        std::vector<float> result(static_cast<size_t>(count) * components);
+        for (size_t v = 0; v < remap.size(); v++)
+            if (remap[v] != 0xFFFFFFFFu)
+                std::copy(values.begin() + v * components, values.begin() + (v + 1) * components, result.begin() + remap[v] * components);
+        values.swap(result);
+    }
+};
+
+#endif
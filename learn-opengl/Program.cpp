@@ -1,7 +1,27 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include <cstring>
 #include "Shaders.h"
+#include "ShaderPermutations.h"
+#include "ShaderHotReload.h"
+#include "FramePacer.h"
+#include "RedrawScheduler.h"
+#include "Simulation.h"
+#include "InputQueue.h"
+#include "UniformBuffer.h"
+#include "UniformBlocks.h"
+#include "VertexFormat.h"
+#include "MeshCache.h"
+#include "BoundingVolumeHierarchy.h"
+#include "GpuCulling.h"
+#include "Transforms.h"
+#include "TransformHierarchy.h"
+#include "EntityWorld.h"
+#include "JobSystem.h"
+#include "TextureArray.h"
+#include "BindlessTextures.h"
+#include "SpriteBatch.h"
 #include "stb_image.h"
 
 //math functions for matrices
@@ -10,13 +30,55 @@
 #include <glm/glm/gtc/type_ptr.hpp>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void window_refresh_callback(GLFWwindow* window);
 void processInput(GLFWwindow* window);
 void KeyCallbacks(GLFWwindow* window, int key, int scancode, int action, int mods);
 
-static bool drawLines = false;
-static float xOffset = 0.0f;
-static float yOffset = 0.0f;
-static float blendScale = 0.2f;
+// Things the user can change with the keyboard
+struct SceneControls
+{
+	float xOffset = 0.0f;
+	float yOffset = 0.0f;
+	float blendScale = 0.2f;
+	// culls and draws the boxes from compute shader written indirect draws instead of the BVH
+	bool gpuCulling = false;
+	// draws a swarm of sprites over the boxes
+	bool sprites = false;
+};
+void handleInput(const InputEvent& event, InputAction action, SceneControls& controls, FramePacer& framePacer);
+
+// Components of the boxes, each box is an entity of the EntityWorld with some of these
+// Where it is: its node in the transform hierarchy
+struct SceneNode
+{
+	uint32_t node;
+};
+// What is drawn: its index in the per object arrays, its uniform block and its GPU culling entries
+struct Renderable
+{
+	uint32_t object;
+};
+// Its proxy in the bounding volume hierarchy, and half the size of a cube that holds it at scale 1
+struct CullBounds
+{
+	int proxy;
+	float halfSize;
+};
+// Animations driven by the simulation: Spin turns it around an axis by the simulation's rotation,
+// Pulse scales it by the simulation's scale times strength
+struct Spin
+{
+	float axis[3];
+};
+struct Pulse
+{
+	float strength;
+};
+
+// The key callback only queues events, they are applied once per frame at a point the render loop chooses
+static InputQueue inputQueue;
+// Only redraws when something changed or an animation is running. Press SPACE to pause the animations
+static RedrawScheduler redrawScheduler;
 
 int main() {
 
@@ -53,6 +115,8 @@ int main() {
 	glfwMakeContextCurrent(window);
 	// Tells GLFW to call out callback function every time window size changes
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+	// Called when the window contents are damaged (uncovered, restored) and have to be drawn again
+	glfwSetWindowRefreshCallback(window, window_refresh_callback);
 
 
 	// Initializing GLAD to manage OpenGL functions
@@ -65,23 +129,24 @@ int main() {
 	}
 
 
-	// Reads text from files and compiles the shader program from that
-	Shader ourShader("VertexShader.txt", "FragmentShader.txt");
+	// Decides how buffer swaps are synced and when input is sampled. Press 'P' to cycle the modes
+	FramePacer framePacer(FramePacer::Mode::VSync);
 
 
-	float vertices[] = {
-		// positions          // colors           // texture coords
-		 0.5f,  0.5f, 0.0f,   1.0f, 0.0f, 0.0f,   1.0f, 1.0f,   // top right
-		 0.5f, -0.5f, 0.0f,   0.0f, 1.0f, 0.0f,   1.0f, 0.0f,   // bottom right
-		-0.5f, -0.5f, 0.0f,   0.0f, 0.0f, 1.0f,   0.0f, 0.0f,   // bottom left
-		-0.5f,  0.5f, 0.0f,   1.0f, 1.0f, 0.0f,   0.0f, 1.0f    // top left 
-	};
-	unsigned int indices[] = {
-		0, 1, 3, // first triangle
-		1, 2, 3  // second triangle
-	};
+	// Loads the SPIR-V made by CompileShaders.bat when the driver supports it, that skips compiling GLSL at startup
+	// Otherwise reads text from files and compiles the shader programs from that
+	// Each variant of the shaders is compiled with a different set of features, see the keys in FragmentShader.txt
+	// From GLSL the vertex and fragment variants are linked separately and combined in program pipelines
+	ShaderPermutations ourShaders("VertexShader.txt", "FragmentShader.txt", { "SINGLE_TEXTURE", "GPU_CULLING", "BINDLESS_TEXTURES" },
+		"VertexShader.spv", "FragmentShader.spv");
+	const unsigned int singleTexture = ourShaders.bit("SINGLE_TEXTURE");
+	const unsigned int gpuCullingVariant = ourShaders.bit("GPU_CULLING");
+	const unsigned int bindlessVariant = ourShaders.bit("BINDLESS_TEXTURES");
+	ourShaders.precompile({ 0, singleTexture });
+	// Recompiles the shaders when VertexShader.txt or FragmentShader.txt are saved, no restart needed
+	ShaderHotReload shaderHotReload(ourShaders);
+
 
-	
 	// (VBO)Vertex buffer object. used to store large amount of vertices to send at the same time to the CPU.
 	// Since it is a slow process to send to the CPU we want to send as much data at the same time
 	// (VAO)Vertex array object is used to store data from the VBO subsequentaly. OpenGL will no draw anything without this
@@ -89,203 +154,390 @@ int main() {
 	// These object is where shit happens but i am not realy sure what is going on behind the sceens
 	// (EBO)Element buffer object is just to store vertices for more than one triangle so we can draw an Element with reduced overlap
 	// Multiples of these are in an array and not seperate
+	// The mesh keeps its vertices and indices in one block so the VBO is used as the EBO too
 	unsigned int VAO;
 	glGenVertexArrays(1, &VAO);
-	unsigned int VBO, EBO;
+	unsigned int VBO;
 	glGenBuffers(1, &VBO);
-	glGenBuffers(1, &EBO);
 
 
 	// Initialization code (done once(unless the object frequently changes))
 
+	// Half float positions and texture coords and one byte per color channel, 16 bytes a vertex
+	// instead of 32 with plain floats. The shader still sees vec3/vec2 since the GL converts them
+	VertexFormat vertexFormat;
+	vertexFormat.add(0, 3, GL_HALF_FLOAT)
+		.add(1, 3, GL_UNSIGNED_BYTE, true)
+		.add(2, 2, GL_HALF_FLOAT);
+
+	// The quad comes from Models/Quad.obj. The first run parses it and writes Models/Quad.obj.cache
+	// already in this format, after that the cache is mapped and copied straight into the buffer
+	PackedMesh quad = loadMesh("Models/Quad.obj", vertexFormat);
+
 	glBindVertexArray(VAO);
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, quad.size(), quad.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, VBO);
+	const void* quadIndices = reinterpret_cast<const void*>(quad.indexOffset());
 
 	// glVertexAttribPointer arguments
 	// Location = 0 so we pass in 0
 	// We use vec3 so we pass in 3 values
-	// We specifies the data type as float
-	// If we want nomalaized data to be used we use GL_TRUE
+	// We specifies the data type (GL_HALF_FLOAT, GL_UNSIGNED_BYTE...)
+	// If we want nomalaized data to be used we use GL_TRUE (0..255 becomes 0..1 for the colors)
 	// Fifth argument is the "stride" it's the distance from one point to another in bytes
 	// The last parameter is the offset off where another stride (for color for example) begins
-	
-	// Position attributes
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-	// Color attributes
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3* sizeof(float)));
-	glEnableVertexAttribArray(1);
-	// Texture attributes
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-	glEnableVertexAttribArray(2);
+	// The vertex format makes these calls for every attribute with the offsets it worked out
+	vertexFormat.apply();
+
+	// Press 'G' to cull and draw the boxes on the GPU, a compute shader writes the draws of the visible ones
+	// The vertex shader finds the transform of its box through the object index attribute at location 4
+	GpuCuller gpuCuller(2);
+	gpuCuller.bindObjectIndex(VAO, 4);
+	// Depth of the last frame as a Hi-Z pyramid, boxes fully behind it are culled too
+	// There is no camera, so the last frame's view projection is the identity matrix like this frame's
+	HiZBuffer hiZ;
+	const uint32_t quadFirstIndex = static_cast<uint32_t>(quad.indexOffset() / (quad.indexType() == GL_UNSIGNED_SHORT ? 2 : 4));
 
 	// Press 'L' to change from Line or Fill triangles
 	// Sets the keycallback we created to a specific window
 	// This is used if we a key press only do someting once per click
 	glfwSetKeyCallback(window, KeyCallbacks);
 
-
-	// Texture 1
-	// Generates texture and stores it in a unasinged int 
-	unsigned int texture1, texture2;
-	glGenTextures(1, &texture1);
-
-	// Binds the texture to the active texture unit
-	glBindTexture(GL_TEXTURE_2D, texture1);
-
-
-	// Set the texture wrapping/filtering options (on the currently bound texture object)
-	// 
-	// Wrapping options:
-	// GL_REPEAT repeats image
-	// GL_MIRRORED_REPEAT self explainatory
-	// GL_CLAMP_TO_EDGE drags the edge out
-	// GL_CMALP_TO_BORDER gives the image a border (needs an exta parameter input for border color)
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	// Filtering options:
-	// GL_LINEAR smooth 
-	// GL_NEARES pixelated
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	// Loads the image from a path and stores it as a char
-	int width, height, nrChannels;
+	// Which key does what
+	SceneControls controls;
+	ActionMap actions;
+	actions.bind(GLFW_KEY_UP, InputAction::MoveUp);
+	actions.bind(GLFW_KEY_DOWN, InputAction::MoveDown);
+	actions.bind(GLFW_KEY_LEFT, InputAction::MoveLeft);
+	actions.bind(GLFW_KEY_RIGHT, InputAction::MoveRight);
+	actions.bind(GLFW_KEY_M, InputAction::BlendMore);
+	actions.bind(GLFW_KEY_N, InputAction::BlendLess);
+	actions.bind(GLFW_KEY_L, InputAction::Wireframe);
+	actions.bind(GLFW_KEY_SPACE, InputAction::ToggleAnimation);
+	actions.bind(GLFW_KEY_P, InputAction::CyclePacing);
+	actions.bind(GLFW_KEY_G, InputAction::ToggleGpuCulling);
+	actions.bind(GLFW_KEY_H, InputAction::ToggleSprites);
+
+
+	// With ARB_bindless_texture every texture is made resident and the shader reads its handle from a buffer, nothing is bound to texture units
+	// The SPIR-V shaders can't do that, so it's only used when the shaders are compiled from GLSL
+	BindlessTextures bindlessTextures;
+	const bool useBindless = bindlessTextures.isSupported() && !ourShaders.usesSpirv();
+	const unsigned int textureVariant = useBindless ? bindlessVariant : 0;
+	if (useBindless)
+		ourShaders.precompile({ bindlessVariant, singleTexture | bindlessVariant });
+
+	// Otherwise every texture goes into one texture array, so they are bound once and each box picks its textures by layer
+	// All three images are 512x512 so each gets a whole layer, smaller ones would be packed together into shared layers
+	// Flips the images since OpenGL expects the first row at the bottom
 	stbi_set_flip_vertically_on_load(true);
-	unsigned char* data = stbi_load("Textures/WoodenContainer.jpg", &width, &height, &nrChannels, 0);
-	
-
-	if (data)
+	TextureArray textures(512);
+	const char* texturePaths[3] = { "Textures/WoodenContainer.jpg", "Textures/awesomeface.png", "Textures/BrickWall.jpg" };
+	TextureRegion loaded[3];
+	if (useBindless)
 	{
-		// Arguments for glTexImage2D
-		// Specify texture target
-		// Specify the Mipmap level
-		// The format we want to the texture as
-		// Sets the width
-		// Sets the height
-		// Always 0 (legacy stuff)
-		// Specify the format of the source img
-		// Specify the datatype of the source img
-		// The actual image data
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		// a bindless texture is a whole texture, so its region is all of it and the "layer" is the index of its handle
+		for (int i = 0; i < 3; i++)
+			loaded[i].layer = bindlessTextures.load(texturePaths[i]);
 	}
 	else
 	{
-		std::cout << "Failed to load texture" << std::endl;
+		// the images are decoded at the same time on the job system's threads
+		textures.load(texturePaths, 3, loaded);
 	}
-	// Frees the imagedata from memory
-	// Use after done loading the image
-	stbi_image_free(data);
-
-	// Texture 2
-	glGenTextures(1, &texture2);
-	glBindTexture(GL_TEXTURE_2D, texture2);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	const TextureRegion& container = loaded[0];
+	const TextureRegion& face = loaded[1];
+	const TextureRegion& brick = loaded[2];
+	// Copies them to the GPU with mipmaps, GL_REPEAT wrapping and GL_LINEAR filtering
+	textures.upload();
+	textures.releaseTexels();
+	// The handles stay bound for good, no other buffer uses their binding
+	bindlessTextures.bind();
+
+	// Press 'H' to draw thousands of small faces over the boxes, they are sprites of one batch so all of them are one draw call
+	// The sprites have their own texture array, like a UI would have its own atlas
+	SpriteBatch spriteBatch;
+	TextureArray spriteTextures(512);
+	TextureRegion spriteFace = spriteTextures.load("Textures/awesomeface.png");
+	spriteTextures.upload();
+	spriteTextures.releaseTexels();
+
+	// The first box blends the face over the container, the second over the brick wall
+	const TextureRegion* boxRegions[2][2] = { { &container, &face }, { &brick, &face } };
+	GpuObjectTextures boxTextures[2] = {};
+	for (int box = 0; box < 2; box++)
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			boxTextures[box].regions[i][0] = boxRegions[box][i]->offset[0];
+			boxTextures[box].regions[i][1] = boxRegions[box][i]->offset[1];
+			boxTextures[box].regions[i][2] = boxRegions[box][i]->scale[0];
+			boxTextures[box].regions[i][3] = boxRegions[box][i]->scale[1];
+			boxTextures[box].layers[i] = boxRegions[box][i]->layer;
+		}
+	}
+	// The boxes never change textures, so the GPU culling path gets them once
+	gpuCuller.setTextures(boxTextures, 0, 2);
 
-	data = stbi_load("Textures/awesomeface.png", &width, &height, &nrChannels, 0);
 
-	if (data)
+	// Uniform blocks for per frame and per object data, each frame writes its blocks into its own part of the buffer
+	// Checks that the structs in UniformBlocks.h match the std140 layout of the shader, against one whole program of it
+	// Programs made from SPIR-V have no names to look the blocks up by, so it's only checked when the GLSL is used
+	if (!ourShaders.usesSpirv())
 	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		Shader& ourShader = ourShaders.get(0);
+		ourShader.verifyUniformBlock("FrameData", sizeof(FrameData), frameDataFields);
+		ourShader.verifyUniformBlock("ObjectData", sizeof(ObjectData), objectDataFields);
 	}
-	else
+	UniformBuffer<FrameData> frameUniforms(0);
+	UniformBuffer<ObjectData> objectUniforms(1, 2);
+
+
+	// Positions, rotations and scales of the boxes in a transform hierarchy, a box's matrix is only recomputed when it or a parent changed
+	// Both boxes are roots here, children added under them would move with them. Nothing is recomputed while the animation is paused
+	TransformHierarchy boxes;
+	uint32_t boxNodes[2] = { boxes.add(TransformHierarchy::none, 0.5f, -0.5f, 0.0f), boxes.add(TransformHierarchy::none, -0.5f, 0.5f, 0.0f) };
+	// Persistently mapped buffer the GPU culling pass and the vertex shader read the matrices from, a part for each frame in flight
+	TransformBuffer boxTransformBuffer(2);
+
+	// The per object block of a box, its transform and where its textures are in the array
+	auto boxData = [&](uint32_t box, const glm::mat4& transform)
 	{
-		std::cout << "Failed to load texture" << std::endl;
-	}
-	stbi_image_free(data);
+		ObjectData data = {};
+		data.transform = transform;
+		std::memcpy(data.textureRegions, boxTextures[box].regions, sizeof(data.textureRegions));
+		std::memcpy(data.textureLayers, boxTextures[box].layers, sizeof(data.textureLayers));
+		return data;
+	};
+
+
+	// Runs the animations on their own thread at a fixed rate, the render loop only interpolates the results
+	SimulationThread simulation(60.0);
+
+
+	// Skips drawing boxes moved completely off screen. There is no camera so the boxes are already in clip space
+	// and the frustum is the one of the identity matrix, a real scene would pass projection * view here
+	Frustum screenFrustum = Frustum::fromMatrix(glm::value_ptr(glm::mat4(1.0f)));
+	// The boxes are kept in a bounding volume hierarchy which culling, picking and finding nearby objects go through
+	DynamicBvh scene;
+	int boxProxies[2];
+	for (uint32_t box = 0; box < 2; box++)
+		boxProxies[box] = scene.insert(Aabb::fromCenter(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f), box);
 
 
-	// tells each uniform sampler in the fragment shader which texture unit they belong to (only has to be done once hence why it is out of the render loop)  
-	ourShader.use();
-	// manualy like this 
-	glUniform1i(glGetUniformLocation(ourShader.ID, "ourTexture1"), 0);
-	// or via the texture class
-	ourShader.setInt("ourTexture2", 1);
+	// The boxes as entities, the render loop goes over them with queries instead of knowing how many there are
+	// Entities with the same components are stored together in arrays, so the queries stay fast with many thousands of them
+	// the quad's corners are 0.7071 from its middle, so a cube of that half size holds the box however it is rotated
+	EntityWorld entities;
+	entities.create(SceneNode{ boxNodes[0] }, Renderable{ 0 }, CullBounds{ boxProxies[0], 0.7071f }, Spin{ { 0.0f, 0.0f, 1.0f } });
+	entities.create(SceneNode{ boxNodes[1] }, Renderable{ 1 }, CullBounds{ boxProxies[1], 0.7071f }, Pulse{ 1.0f });
 
 
 	// Checks if GLFW has been instructed to close (this is the render loop)
 	while (!glfwWindowShouldClose(window))
 	{
 		// Inputs below here:
-		
-		// Function for closing the window with ESC
-		processInput(window);
 
-		// moves the object on the screen
-		ourShader.setFloat("xOffset", xOffset);
-		ourShader.setFloat("yOffset", yOffset);
-		ourShader.setFloat("blendScale", blendScale);
+		// In low latency mode this waits until the latest point we can sample input and still make the next frame
+		framePacer.waitForInputSample();
 
+		// Checks if any event is triggerd like keyboard input and mouse movement
+		// We can use callback functions here to do stuff with input
+		// When nothing needs to be drawn this sleeps until an event arrives instead of polling
+		redrawScheduler.processEvents();
 
-		// Rendering commands below here:
+		// Function for closing the window with ESC
+		processInput(window);
 
-		// Change the color of the window
-		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
+		// Applies everything the key callback queued since the last frame
+		inputQueue.drain(actions, [&](const InputEvent& event, InputAction action) {
+			handleInput(event, action, controls, framePacer);
+		});
 
-		// Activates a texture unit. we can have up to 16 per shader GL_TEXTURE0 - 15
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture1);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, texture2);
+		// Swaps in the new shader programs if the shader files were edited
+		if (shaderHotReload.update())
+		{
+			redrawScheduler.markDirty();
+		}
 
+		// Pausing the animations also stops the simulation thread
+		simulation.setPaused(!redrawScheduler.isAnimating());
 
+		// Nothing changed since the last frame so there is no need to draw it again
+		if (!redrawScheduler.needsRedraw())
+		{
+			continue;
+		}
 
-		// Creates a transformation, and the initial matrix is set to identity matrix
-		glm::mat4 transform = glm::mat4(1.0f);
-		// Changes the position of the box by changin T in the matrix [ 1  0  0  T] by multiplying whats in the vec3 parameter
-		//															  [ 0  1  0  T]
-		//															  [ 0  0  1  T]
-		transform = glm::translate(transform, glm::vec3(0.5f, -0.5f, 0.0f));
-		transform = glm::rotate(transform, (float)glfwGetTime(), glm::vec3(0.0f, 0.0f, 1.0f));
+		// Gets the simulation state for this frame blended between the last two simulation ticks
+		SimulationState state = simulation.sample();
 
-		// gets and sets the uniform transform variable so the shader will transform the box
-		unsigned int transformLoc = glGetUniformLocation(ourShader.ID, "transform");
-		glUniformMatrix4fv(transformLoc, 1, GL_FALSE, glm::value_ptr(transform));
+		// Waits until the GPU is done with the uniform blocks we are about to overwrite
+		frameUniforms.beginFrame();
+		objectUniforms.beginFrame();
+		boxTransformBuffer.beginFrame();
 
+		// moves the object on the screen
+		FrameData frameData = {};
+		frameData.offset[0] = controls.xOffset;
+		frameData.offset[1] = controls.yOffset;
+		frameData.blendScale = controls.blendScale;
+		frameUniforms.bind(frameUniforms.push(frameData));
 
-		glBindVertexArray(VAO);
-		// Draws the elements from EBO
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+		// Nothing of the second texture shows when it isn't blended in, so the variant that skips it is used
+		ourShaders.use((controls.blendScale <= 0.0f ? singleTexture : 0) | textureVariant);
 
-		// Mostly the same as above
-		transform = glm::mat4(1.0f); // Reset the matrix to identity matrix
-		transform = glm::translate(transform, glm::vec3(-0.5f, 0.5f, 0.0f));
-		float scaleAmount = static_cast<float>(sin(glfwGetTime()));
-		// Changes the scale of the box by changing S in the matrix [ S  0  0  0] by multiplying whats in the vec3 parameter
-		//															[ 0  S  0  0]
-		//															[ 0  0  S  0]
-		transform = glm::scale(transform, glm::vec3(scaleAmount, scaleAmount, scaleAmount));
-		glUniformMatrix4fv(transformLoc, 1, GL_FALSE, &transform[0][0]);
 
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+		// Rendering commands below here:
+
+		// Change the color of the window
+		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+		// The depth is cleared too since the Hi-Z pyramid for GPU culling is built from it
+		// LEQUAL lets the later box draw over the earlier one where they overlap at the same depth, same as without depth testing
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_LEQUAL);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		// Binds the texture array to texture unit 0, the sampler in the fragment shader is set to that unit with its binding
+		// It's bound every frame because the GPU culling pass uses unit 0 for the Hi-Z pyramid. Bindless textures need no binding
+		if (!useBindless)
+			textures.bind(0);
+
+
+
+		// The animations: the first box has Spin and turns around the z axis, the second one has Pulse and grows and shrinks
+		// Each matrix is translate * rotate * scale, the translation is T, the scale S and the rotation R in
+		// [ R*S  R*S  R*S  T]
+		// [ R*S  R*S  R*S  T]
+		// [ R*S  R*S  R*S  T]
+		// [  0    0    0   1]
+		entities.each<const SceneNode, const Spin>([&](Entity, const SceneNode& node, const Spin& spin) {
+			boxes.setAxisAngle(node.node, state.rotation, spin.axis[0], spin.axis[1], spin.axis[2]);
+		});
+		entities.each<const SceneNode, const Pulse>([&](Entity, const SceneNode& node, const Pulse& pulse) {
+			float scaleAmount = state.scale * pulse.strength;
+			boxes.setScale(node.node, scaleAmount, scaleAmount, scaleAmount);
+		});
+		// The world matrices also go straight into this frame's part of the mapped buffer the GPU culling pass reads them from,
+		// in node order. The boxes are the two roots in the order they were added, so object 0 and 1 are nodes 0 and 1
+		// Every part has to be written again when its frame comes around, so all of them are written every frame, changed or not
+		boxes.update(boxTransformBuffer.data());
+
+		// writes the transforms into the uniform blocks so the shader will transform the boxes, and moves their bounds in the BVH
+		int boxBlocks[2];
+		entities.each<const SceneNode, const Renderable, const CullBounds>([&](Entity, const SceneNode& node, const Renderable& renderable, const CullBounds& bounds) {
+			const glm::mat4& transform = boxes.worldMatrix(node.node);
+			boxBlocks[renderable.object] = objectUniforms.push(boxData(renderable.object, transform));
+			// the offset is added to the vertices before the transform so it moves the middle the same way
+			glm::vec4 center = transform * glm::vec4(controls.xOffset, controls.yOffset, 0.0f, 1.0f);
+			// the bounds grow with the longest axis of the matrix
+			float scale = 0.0f;
+			for (int axis = 0; axis < 3; axis++)
+				scale = std::max(scale, std::sqrt(transform[axis][0] * transform[axis][0] + transform[axis][1] * transform[axis][1] + transform[axis][2] * transform[axis][2]));
+			float halfSize = bounds.halfSize * scale;
+			scene.move(bounds.proxy, Aabb::fromCenter(center.x, center.y, center.z, halfSize, halfSize, halfSize));
+		});
+		scene.maintain();
+
+
+		if (controls.gpuCulling && gpuCuller.isSupported())
+		{
+			// Both boxes draw the whole quad, their bounding spheres are around the quad's middle moved by the offset
+			GpuObjectBounds quadBounds = { { controls.xOffset, controls.yOffset, 0.0f, 0.7071f }, static_cast<uint32_t>(quad.indexCount()), quadFirstIndex, 0, 0 };
+			GpuObjectBounds boxGpuBounds[2] = { quadBounds, quadBounds };
+			gpuCuller.setTransformBuffer(&boxTransformBuffer);
+			gpuCuller.setObjects(nullptr, boxGpuBounds, 2);
+			gpuCuller.cull(screenFrustum, &hiZ);
+
+			// culling used its own program, so the shader is set again with the transforms coming from the buffer
+			ourShaders.use((controls.blendScale <= 0.0f ? singleTexture : 0) | gpuCullingVariant | textureVariant);
+			glBindVertexArray(VAO);
+			gpuCuller.draw(GL_TRIANGLES, quad.indexType());
+		}
+		else
+		{
+			glBindVertexArray(VAO);
+			// Binds the block of each box still on screen and draws the elements from EBO
+			bool boxVisible[2] = {};
+			scene.cull(screenFrustum, [&](uint32_t box) { boxVisible[box] = true; });
+			for (int box = 0; box < 2; box++)
+			{
+				if (!boxVisible[box])
+					continue;
+				objectUniforms.bind(boxBlocks[box]);
+				glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(quad.indexCount()), quad.indexType(), quadIndices);
+			}
+		}
+
+		// The sprites go on top in window pixels with y going up, on a spiral that turns with the animation
+		spriteBatch.beginFrame();
+		if (controls.sprites && spriteBatch.isSupported())
+		{
+			int framebufferWidth, framebufferHeight;
+			glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+			float width = static_cast<float>(framebufferWidth), height = static_cast<float>(framebufferHeight);
+			spriteBatch.begin(glm::ortho(0.0f, width, 0.0f, height));
+			// Room for all of them is taken at once and the job system's threads fill it in together
+			const size_t spriteCount = 20000;
+			SpriteInstance* sprites = spriteBatch.allocate(spriteTextures.ID, spriteCount);
+			if (sprites)
+			{
+				JobSystem::shared().parallelFor(spriteCount, 1024, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; i++)
+					{
+						// golden angle steps spread them evenly over a disc
+						float angle = i * 2.39996f + static_cast<float>(state.time) * 0.5f;
+						float radius = 0.5f * std::min(width, height) * std::sqrt((i + 0.5f) / spriteCount);
+						SpriteInstance sprite = SpriteBatch::sprite(spriteFace, 0.5f * width + radius * std::cos(angle), 0.5f * height + radius * std::sin(angle), 12.0f, 12.0f, angle);
+						std::memcpy(sprites + i, &sprite, sizeof(SpriteInstance));
+					}
+				});
+			}
+			spriteBatch.end();
+		}
+		spriteBatch.endFrame();
+
+		// Marks the blocks as in use until the GPU is done with these draws
+		frameUniforms.endFrame();
+		objectUniforms.endFrame();
+		boxTransformBuffer.endFrame();
+
+		// The depth of this frame is what the next one is culled against
+		if (controls.gpuCulling && hiZ.isSupported())
+		{
+			int framebufferWidth, framebufferHeight;
+			glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+			hiZ.build(framebufferWidth, framebufferHeight);
+		}
+		else
+		{
+			// Without builds the pyramid gets older every frame, switching GPU culling back on must not cull against it
+			hiZ.invalidate();
+		}
 
 
 		// Check and call events and swap the buffers below here
-		
+
+		// The frame's work ends here, the swap below may wait for the vblank
+		framePacer.markWorkDone();
 		// Swaps the color buffer 
 		// (large 2D buffer that contains color values for each pixel in GLFWs window)
 		// that is used to render and show as output on the screen
 		glfwSwapBuffers(window);
+		redrawScheduler.frameRendered();
 
-		// Checks if any event is triggerd like keyboard input and mouse movement
-		// We can use callback functions here to do stuff with input
-		glfwPollEvents();
+		// Sleeps out the rest of the frame when the frame rate is capped
+		framePacer.endFrame();
 	}
 
+	const InputLatencyStats& latency = inputQueue.latency();
+	std::cout << "Input events: " << latency.events << " (" << latency.dropped << " dropped), average latency "
+		<< latency.averageMilliseconds() << "ms, max " << latency.maxMicroseconds / 1000.0 << "ms" << std::endl;
+
 	// optional: de-allocate all resources once they've outlived their purpose
 	glDeleteVertexArrays(1, &VAO);
 	glDeleteBuffers(1, &VBO);
-	glDeleteBuffers(1, &EBO);
 
 	// Cleans up all the resources used and properly exits the application
 	glfwTerminate();
@@ -296,6 +548,12 @@ int main() {
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
 	// Tells OpenGL Potition of window and size
 	glViewport(0, 0, width, height);
+	redrawScheduler.markDirty();
+}
+
+void window_refresh_callback(GLFWwindow* window) {
+	// The window contents were lost so the next frame has to be drawn
+	redrawScheduler.markDirty();
 }
 
 void processInput(GLFWwindow* window) {
@@ -306,75 +564,94 @@ void processInput(GLFWwindow* window) {
 	}
 }
 
-// A callback function that registers a key press and does something after that
+// A callback function that registers a key press and queues it for the render loop
 void KeyCallbacks(GLFWwindow* window, int key, int scancode, int action, int mods) 
 {
-	if (action == GLFW_RELEASE)
+	// The event already woke the render loop up if it was waiting, handleInput decides if it needs a new frame
+	inputQueue.pushKey(key, scancode, action, mods);
+}
+
+// Does something with a key press once the render loop gets to it
+// Only keys bound to an action that changed something mark the frame for redrawing, unbound keys, releases and repeats that do nothing don't
+void handleInput(const InputEvent& event, InputAction action, SceneControls& controls, FramePacer& framePacer)
+{
+	// Hold Toggle
+	if (action == InputAction::Wireframe)
 	{
+		if (event.action == GLFW_PRESS)
+		{
+			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+			redrawScheduler.markDirty();
+		}
+		if (event.action == GLFW_RELEASE)
+		{
+			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+			redrawScheduler.markDirty();
+		}
 		return;
 	}
 
-	switch (key)
+	if (event.action == GLFW_RELEASE)
 	{
-	case GLFW_KEY_DOWN:
-		yOffset -= 0.1;
+		return;
+	}
+
+	// The toggles only switch on the press, not on its repeats
+	bool toggle = action == InputAction::ToggleAnimation || action == InputAction::ToggleGpuCulling
+		|| action == InputAction::ToggleSprites || action == InputAction::CyclePacing;
+	if (toggle && event.action != GLFW_PRESS)
+	{
+		return;
+	}
+
+	switch (action)
+	{
+	case InputAction::MoveDown:
+		controls.yOffset -= 0.1f;
 		break;
 
-	case GLFW_KEY_UP:
-		yOffset += 0.1;
+	case InputAction::MoveUp:
+		controls.yOffset += 0.1f;
 		break;
 
-	case GLFW_KEY_LEFT:
-		xOffset -= 0.1;
+	case InputAction::MoveLeft:
+		controls.xOffset -= 0.1f;
 		break;
 
-	case GLFW_KEY_RIGHT:
-		xOffset += 0.1;
+	case InputAction::MoveRight:
+		controls.xOffset += 0.1f;
 		break;
 
-	case GLFW_KEY_M:
-		blendScale += 0.1;
+	case InputAction::BlendMore:
+		controls.blendScale += 0.1f;
 		break;
 
-	case GLFW_KEY_N:
-		blendScale -= 0.1;
+	case InputAction::BlendLess:
+		controls.blendScale -= 0.1f;
 		break;
 
-		default:
-			break;
-	}
+	case InputAction::ToggleAnimation:
+		redrawScheduler.setAnimating(!redrawScheduler.isAnimating());
+		break;
+
+	case InputAction::ToggleGpuCulling:
+		controls.gpuCulling = !controls.gpuCulling;
+		std::cout << "GPU culling: " << (controls.gpuCulling ? "on" : "off") << std::endl;
+		break;
 
+	case InputAction::ToggleSprites:
+		controls.sprites = !controls.sprites;
+		std::cout << "Sprites: " << (controls.sprites ? "on" : "off") << std::endl;
+		break;
 
-	// Click Toggle
-	//if (key == GLFW_KEY_L && action == GLFW_PRESS)
-	//{
-	//	if (drawLines == true)
-	//	{
-	//		drawLines = false;
-	//	}
-	//	else if (drawLines == false)
-	//	{
-	//		drawLines = true;
-	//	}
-
-	//	if (drawLines == true)
-	//	{
-	//		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	//	}
-	//	if (drawLines == false)
-	//	{
-	//		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-	//	}
-	//}
+	case InputAction::CyclePacing:
+		framePacer.cycleMode();
+		std::cout << "Frame pacing: " << FramePacer::modeName(framePacer.getMode()) << std::endl;
+		break;
 
-	// Hold Toggle
-	if (key == GLFW_KEY_L && action == GLFW_PRESS)
-	{
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	}
-	if (key == GLFW_KEY_L && action == GLFW_RELEASE)
-	{
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	default:
+		return;
 	}
-}
 
+	redrawScheduler.markDirty();
+}
@@ -0,0 +1,324 @@
+#ifndef PROGRAM_PIPELINE_H
+#define PROGRAM_PIPELINE_H
+
+#include "Shaders.h"
+#include "ShaderPreprocessor.h"
+
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One shader stage linked on its own as a GL_PROGRAM_SEPARABLE program. Stages are combined
+// into program pipelines at bind time, so N vertex and M fragment variants cost N + M links
+// instead of N * M. Vertex stages have to redeclare gl_PerVertex to be used like this.
+class ShaderStage
+{
+public:
+    unsigned int ID = 0;
+    GLenum type = 0;
+
+    // ------------------------------------------------------------------------
+    static ShaderStage fromSource(GLenum type, const std::string& source)
+    {
+        ShaderStage stage;
+        stage.type = type;
+        const char* code = source.c_str();
+        // compiles, sets GL_PROGRAM_SEPARABLE and links in one call
+        stage.ID = glCreateShaderProgramv(type, 1, &code);
+        int success = 0;
+        glGetProgramiv(stage.ID, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            char infoLog[1024];
+            glGetProgramInfoLog(stage.ID, 1024, NULL, infoLog);
+            std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: SEPARABLE " << stageName(type) << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+        }
+        return stage;
+    }
+
+    bool isLinked() const
+    {
+        int success = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        return success != 0;
+    }
+
+    // bit for glUseProgramStages
+    GLbitfield stageBit() const
+    {
+        switch (type)
+        {
+        case GL_VERTEX_SHADER: return GL_VERTEX_SHADER_BIT;
+        case GL_FRAGMENT_SHADER: return GL_FRAGMENT_SHADER_BIT;
+        case GL_GEOMETRY_SHADER: return GL_GEOMETRY_SHADER_BIT;
+        case GL_TESS_CONTROL_SHADER: return GL_TESS_CONTROL_SHADER_BIT;
+        case GL_TESS_EVALUATION_SHADER: return GL_TESS_EVALUATION_SHADER_BIT;
+        default: return GL_COMPUTE_SHADER_BIT;
+        }
+    }
+
+    static const char* stageName(GLenum type)
+    {
+        switch (type)
+        {
+        case GL_VERTEX_SHADER: return "VERTEX";
+        case GL_FRAGMENT_SHADER: return "FRAGMENT";
+        case GL_COMPUTE_SHADER: return "COMPUTE";
+        default: return "STAGE";
+        }
+    }
+};
+
+// Permutations (see ShaderPermutations.h) of a single stage. A mask is reduced to the keys the
+// stage's preprocessor conditions (#if, #ifdef, #ifndef, #elif) actually test before looking
+// it up, so e.g. a vertex shader that ignores SINGLE_TEXTURE is compiled once and shared by
+// both fragment variants.
+class StagePermutations
+{
+public:
+    // ------------------------------------------------------------------------
+    StagePermutations(GLenum type, const std::string& path, const std::vector<std::string>& keys,
+        ShaderPreprocessor& preprocessor = ShaderPreprocessor::shared())
+        : type(type), path(path), keys(keys), preprocessor(preprocessor)
+    {
+        source = preprocessor.expand(path);
+        relevantKeys = keysTested(source, keys);
+    }
+
+    ~StagePermutations()
+    {
+        for (auto& stage : stages)
+            glDeleteProgram(stage.second.ID);
+        discard();
+    }
+
+    StagePermutations(const StagePermutations&) = delete;
+    StagePermutations& operator=(const StagePermutations&) = delete;
+
+    // the mask with the keys this stage doesn't test taken out
+    unsigned int reduce(unsigned int mask) const { return mask & relevantKeys; }
+
+    // the stage variant for a mask, compiled on first use
+    // ------------------------------------------------------------------------
+    const ShaderStage& get(unsigned int mask)
+    {
+        mask = reduce(mask);
+        auto found = stages.find(mask);
+        if (found != stages.end())
+            return found->second;
+        return stages.emplace(mask, compile(source, mask)).first->second;
+    }
+
+    // Reads the file again and compiles every variant compiled so far into a pending set, true
+    // when all of them linked. commit swaps them in, discard drops them; hot reload does one or
+    // the other for every stage so the stages never mix old and new sources
+    // ------------------------------------------------------------------------
+    bool prepare()
+    {
+        discard();
+        std::string newSource = preprocessor.expand(path);
+        if (newSource.empty())
+            return false;
+        pendingSource = newSource;
+        bool success = true;
+        for (auto& stage : stages)
+        {
+            ShaderStage compiled = compile(newSource, stage.first);
+            pending.emplace(stage.first, compiled);
+            success = success && compiled.isLinked();
+        }
+        return success;
+    }
+
+    void commit()
+    {
+        for (auto& stage : pending)
+        {
+            glDeleteProgram(stages[stage.first].ID);
+            stages[stage.first] = stage.second;
+        }
+        pending.clear();
+        source = pendingSource;
+        relevantKeys = keysTested(source, keys);
+    }
+
+    void discard()
+    {
+        for (auto& stage : pending)
+            glDeleteProgram(stage.second.ID);
+        pending.clear();
+    }
+
+    // "#define KEY" lines for the keys set in mask
+    // ------------------------------------------------------------------------
+    static std::string definesFor(const std::vector<std::string>& keys, unsigned int mask)
+    {
+        std::string defines;
+        for (size_t i = 0; i < keys.size(); i++)
+            if (mask & (1u << i))
+                defines += "#define " + keys[i] + "\n";
+        return defines;
+    }
+
+    // #version has to stay the first line so the defines go right after it
+    // ------------------------------------------------------------------------
+    static std::string inject(const std::string& source, const std::string& defines)
+    {
+        size_t version = source.find("#version");
+        if (version == std::string::npos)
+            return defines + source;
+        size_t lineEnd = source.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return source + "\n" + defines;
+        // an expanded source already has a #line with its source number after #version,
+        // the defines go in front of it so it still applies to the next line
+        if (source.compare(lineEnd + 1, 6, "#line ") == 0)
+            return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+        // #line keeps compile errors pointing at the right line of the file
+        size_t nextLine = std::count(source.begin(), source.begin() + lineEnd, '\n') + 2;
+        return source.substr(0, lineEnd + 1) + defines + "#line " + std::to_string(nextLine) + "\n" + source.substr(lineEnd + 1);
+    }
+
+    // bits of the keys named as whole identifiers in #if, #ifdef, #ifndef and #elif lines,
+    // a key that is only mentioned in a comment or in code doesn't change the stage
+    // ------------------------------------------------------------------------
+    static unsigned int keysTested(const std::string& source, const std::vector<std::string>& keys)
+    {
+        unsigned int tested = 0;
+        std::istringstream lines(source);
+        std::string line;
+        while (std::getline(lines, line))
+        {
+            size_t start = line.find_first_not_of(" \t");
+            if (start == std::string::npos || line[start] != '#')
+                continue;
+            size_t nameStart = line.find_first_not_of(" \t", start + 1);
+            if (nameStart == std::string::npos)
+                continue;
+            size_t nameEnd = nameStart;
+            while (nameEnd < line.size() && std::isalpha(static_cast<unsigned char>(line[nameEnd])))
+                nameEnd++;
+            std::string name = line.substr(nameStart, nameEnd - nameStart);
+            if (name != "if" && name != "ifdef" && name != "ifndef" && name != "elif")
+                continue;
+            // a // comment on the line isn't part of the condition
+            size_t end = std::min(line.find("//", nameEnd), line.size());
+            size_t i = nameEnd;
+            while (i < end)
+            {
+                if (!std::isalpha(static_cast<unsigned char>(line[i])) && line[i] != '_')
+                {
+                    i++;
+                    continue;
+                }
+                size_t identifierStart = i;
+                while (i < end && (std::isalnum(static_cast<unsigned char>(line[i])) || line[i] == '_'))
+                    i++;
+                std::string identifier = line.substr(identifierStart, i - identifierStart);
+                for (size_t k = 0; k < keys.size(); k++)
+                    if (keys[k] == identifier)
+                        tested |= 1u << k;
+            }
+        }
+        return tested;
+    }
+
+private:
+    GLenum type;
+    std::string path;
+    std::vector<std::string> keys;
+    ShaderPreprocessor& preprocessor;
+    std::string source;
+    unsigned int relevantKeys = 0;
+    std::unordered_map<unsigned int, ShaderStage> stages;
+    std::unordered_map<unsigned int, ShaderStage> pending;
+    std::string pendingSource;
+
+    ShaderStage compile(const std::string& text, unsigned int mask) const
+    {
+        ShaderStage stage = ShaderStage::fromSource(type, inject(text, definesFor(keys, mask)));
+        // errors name sources by number, print which file each number is
+        if (!stage.isLinked())
+            std::cout << "Shader source numbers: " << preprocessor.describeSources() << std::endl;
+        return stage;
+    }
+};
+
+// Program pipeline objects of one vertex and one fragment StagePermutations. A pipeline is
+// keyed by the pair of reduced masks it combines, so variants that only differ in keys one
+// stage ignores share that stage
+class PipelineCache
+{
+public:
+    // ------------------------------------------------------------------------
+    PipelineCache(StagePermutations& vertex, StagePermutations& fragment)
+        : vertex(vertex), fragment(fragment)
+    {
+    }
+
+    PipelineCache(const PipelineCache&) = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+
+    ~PipelineCache()
+    {
+        clear();
+    }
+
+    // the pipeline for a variant, its stages and itself created on first use
+    // ------------------------------------------------------------------------
+    unsigned int get(unsigned int mask)
+    {
+        unsigned long long key = (static_cast<unsigned long long>(vertex.reduce(mask)) << 32) | fragment.reduce(mask);
+        auto found = pipelines.find(key);
+        if (found != pipelines.end())
+            return found->second;
+
+        const ShaderStage& vertexStage = vertex.get(mask);
+        const ShaderStage& fragmentStage = fragment.get(mask);
+        unsigned int pipeline;
+        glCreateProgramPipelines(1, &pipeline);
+        glUseProgramStages(pipeline, vertexStage.stageBit(), vertexStage.ID);
+        glUseProgramStages(pipeline, fragmentStage.stageBit(), fragmentStage.ID);
+#ifndef NDEBUG
+        // checks the stage interfaces match, debug builds only since it is not free
+        glValidateProgramPipeline(pipeline);
+        int valid = 0;
+        glGetProgramPipelineiv(pipeline, GL_VALIDATE_STATUS, &valid);
+        if (!valid)
+        {
+            char infoLog[1024];
+            glGetProgramPipelineInfoLog(pipeline, 1024, NULL, infoLog);
+            std::cout << "ERROR::PROGRAM_PIPELINE_VALIDATION_ERROR\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+        }
+#endif
+        pipelines.emplace(key, pipeline);
+        return pipeline;
+    }
+
+    // binds the pipeline, an active glUseProgram program would take priority over it
+    // ------------------------------------------------------------------------
+    void bind(unsigned int mask)
+    {
+        glUseProgram(0);
+        glBindProgramPipeline(get(mask));
+    }
+
+    // deletes every pipeline, needed after the stages were recompiled
+    // ------------------------------------------------------------------------
+    void clear()
+    {
+        for (auto& pipeline : pipelines)
+            glDeleteProgramPipelines(1, &pipeline.second);
+        pipelines.clear();
+    }
+
+private:
+    StagePermutations& vertex;
+    StagePermutations& fragment;
+    std::unordered_map<unsigned long long, unsigned int> pipelines;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef REDRAW_SCHEDULER_H
+#define REDRAW_SCHEDULER_H
+
+#include <GLFW/glfw3.h>
+
+// Decides whether the render loop needs to draw a frame at all. In on demand mode the loop
+// sleeps in glfwWaitEventsTimeout until something marks the scene dirty (input, resize,
+// window damage) or an animation is running, so a static scene costs no CPU.
+class RedrawScheduler
+{
+public:
+    // idleTimeout is how long we sleep at most before the loop gets to run housekeeping
+    // ------------------------------------------------------------------------
+    explicit RedrawScheduler(bool onDemand = true, double idleTimeout = 0.25)
+        : onDemand(onDemand), idleTimeout(idleTimeout)
+    {
+    }
+
+    // something visible changed, draw the next frame
+    void markDirty() { dirty = true; }
+
+    // while animating we draw every frame
+    void setAnimating(bool value)
+    {
+        animating = value;
+        dirty = true;
+    }
+    bool isAnimating() const { return animating; }
+
+    void setOnDemand(bool value)
+    {
+        onDemand = value;
+        dirty = true;
+    }
+    bool isOnDemand() const { return onDemand; }
+
+    // replaces glfwPollEvents. Blocks until there are events when there is nothing to draw
+    // ------------------------------------------------------------------------
+    void processEvents()
+    {
+        if (needsRedraw())
+            glfwPollEvents();
+        else
+            glfwWaitEventsTimeout(idleTimeout);
+    }
+
+    bool needsRedraw() const { return !onDemand || dirty || animating; }
+
+    // call once a frame has been swapped
+    void frameRendered() { dirty = false; }
+
+private:
+    bool onDemand;
+    double idleTimeout;
+    bool dirty = true;
+    bool animating = true;
+};
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef SHADER_HOT_RELOAD_H
+#define SHADER_HOT_RELOAD_H
+
+#include "ShaderPermutations.h"
+
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <sys/stat.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Watches a set of files from a background thread. Uses inotify on Linux and compares file
+// modification times four times a second everywhere else.
+class FileWatcher
+{
+public:
+    // ------------------------------------------------------------------------
+    explicit FileWatcher(const std::vector<std::string>& paths)
+        : paths(paths)
+    {
+        for (const std::string& path : paths)
+            modified.push_back(modificationTime(path));
+        worker = std::thread(&FileWatcher::run, this);
+    }
+
+    ~FileWatcher()
+    {
+        running = false;
+        worker.join();
+    }
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // files that changed since the last call
+    // ------------------------------------------------------------------------
+    std::vector<std::string> takeChanges()
+    {
+        std::lock_guard<std::mutex> lock(changesMutex);
+        std::vector<std::string> result(changes.begin(), changes.end());
+        changes.clear();
+        return result;
+    }
+
+private:
+    std::vector<std::string> paths;
+    std::vector<long long> modified;
+    std::thread worker;
+    std::atomic<bool> running{ true };
+    std::mutex changesMutex;
+    std::set<std::string> changes;
+
+    // stat times only have second resolution, so the size is mixed in to catch two saves within a second
+    static long long modificationTime(const std::string& path)
+    {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            return 0;
+        return (static_cast<long long>(info.st_mtime) << 24) ^ static_cast<long long>(info.st_size);
+    }
+
+    void changed(const std::string& path)
+    {
+        {
+            std::lock_guard<std::mutex> lock(changesMutex);
+            changes.insert(path);
+        }
+        // wakes the render loop up if it is idle in glfwWaitEventsTimeout
+        glfwPostEmptyEvent();
+    }
+
+    void pollModificationTimes()
+    {
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            long long time = modificationTime(paths[i]);
+            if (time != modified[i])
+            {
+                modified[i] = time;
+                changed(paths[i]);
+            }
+        }
+    }
+
+    void run()
+    {
+#ifdef __linux__
+        // watch the directories, editors often save by writing a new file and renaming it over the old one
+        int fd = inotify_init1(IN_NONBLOCK);
+        std::vector<std::pair<int, std::string>> watches;
+        for (const std::string& path : paths)
+        {
+            size_t slash = path.find_last_of('/');
+            std::string directory = slash == std::string::npos ? "." : path.substr(0, slash);
+            int wd = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+            watches.push_back({ wd, slash == std::string::npos ? path : path.substr(slash + 1) });
+        }
+        if (fd >= 0)
+        {
+            alignas(inotify_event) char buffer[4096];
+            while (running)
+            {
+                pollfd descriptor = { fd, POLLIN, 0 };
+                if (poll(&descriptor, 1, 250) <= 0)
+                    continue;
+                ssize_t length = read(fd, buffer, sizeof(buffer));
+                for (ssize_t offset = 0; offset < length;)
+                {
+                    const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                    for (size_t i = 0; i < watches.size(); i++)
+                        if (event->len > 0 && watches[i].first == event->wd && watches[i].second == event->name)
+                            changed(paths[i]);
+                    offset += sizeof(inotify_event) + event->len;
+                }
+            }
+            close(fd);
+            return;
+        }
+#endif
+        while (running)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(250));
+            pollModificationTimes();
+        }
+    }
+};
+
+// Recompiles a set of shader permutations when their source files change. Reloading happens
+// on the render thread at the start of a frame (update), the watcher thread only detects the
+// edit, so no GL calls ever happen off the thread that owns the context. A shader that fails
+// to compile keeps the previous program.
+class ShaderHotReload
+{
+public:
+    // ------------------------------------------------------------------------
+    explicit ShaderHotReload(ShaderPermutations& shaders, ShaderPreprocessor& preprocessor = ShaderPreprocessor::shared())
+        : shaders(shaders), preprocessor(preprocessor), watchedFiles(shaders.sourceFiles()),
+          watcher(new FileWatcher(watchedFiles))
+    {
+    }
+
+    // call at the start of a frame, returns true when new programs were swapped in
+    // ------------------------------------------------------------------------
+    bool update()
+    {
+        std::vector<std::string> changed = watcher->takeChanges();
+        if (changed.empty())
+            return false;
+
+        for (const std::string& path : changed)
+            preprocessor.invalidate(path);
+        if (shaders.reload())
+        {
+            std::cout << "Reloaded " << shaders.getVertexPath() << " and " << shaders.getFragmentPath() << std::endl;
+            // the edit may have added or removed includes
+            std::vector<std::string> files = shaders.sourceFiles();
+            if (files != watchedFiles)
+            {
+                watchedFiles = files;
+                watcher.reset(new FileWatcher(watchedFiles));
+            }
+            return true;
+        }
+        std::cout << "ERROR::SHADER::RELOAD_FAILED: keeping the previous programs" << std::endl;
+        return false;
+    }
+
+private:
+    ShaderPermutations& shaders;
+    ShaderPreprocessor& preprocessor;
+    std::vector<std::string> watchedFiles;
+    std::unique_ptr<FileWatcher> watcher;
+};
+
+#endif
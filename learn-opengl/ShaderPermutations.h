@@ -0,0 +1,236 @@
+#ifndef SHADER_PERMUTATIONS_H
+#define SHADER_PERMUTATIONS_H
+
+#include "Shaders.h"
+#include "ShaderPreprocessor.h"
+#include "ProgramPipeline.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compiles variants of one vertex/fragment pair with different feature keys switched on,
+// so shaders can have specialised fast paths instead of branching at runtime.
+//
+// Each key gets a bit, a variant is the bitmask of the keys it has on. From GLSL the keys are
+// #defines injected after the #version line. From SPIR-V key i is specialization constant i
+// set to 1 or 0, so shaders declare each key as
+//
+//     #ifdef GL_SPIRV
+//     layout (constant_id = 0) const bool singleTexture = false;
+//     #elif defined(SINGLE_TEXTURE)
+//     const bool singleTexture = true;
+//     #else
+//     const bool singleTexture = false;
+//     #endif
+//
+// Variants are compiled the first time they are asked for, or up front with precompile.
+// GLSL sources go through ShaderPreprocessor so they can #include shared files.
+//
+// From GLSL a variant is drawn with a program pipeline (ProgramPipeline.h): each stage is
+// compiled and linked on its own for the keys it tests, so N vertex and M fragment variants
+// cost N + M links instead of N * M. SPIR-V variants are specialized as whole programs.
+class ShaderPermutations
+{
+public:
+    // spirv paths are optional, when given and supported variants are specialized from them
+    // ------------------------------------------------------------------------
+    ShaderPermutations(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& keys,
+        const char* vertexSpirvPath = nullptr, const char* fragmentSpirvPath = nullptr,
+        ShaderPreprocessor& preprocessor = ShaderPreprocessor::shared())
+        : keys(keys), vertexPath(vertexPath), fragmentPath(fragmentPath), preprocessor(preprocessor)
+    {
+        // expanded first either way, the SPIR-V files are only used when they are newer than every
+        // file the GLSL pulls in
+        vertexSource = preprocessor.expand(vertexPath);
+        fragmentSource = preprocessor.expand(fragmentPath);
+        if (vertexSpirvPath && fragmentSpirvPath && Shader::canLoadSpirv(vertexSpirvPath, fragmentSpirvPath, sourceFiles()))
+        {
+            spirvPaths[0] = vertexSpirvPath;
+            spirvPaths[1] = fragmentSpirvPath;
+            useSpirv = true;
+        }
+        else
+            createStages();
+    }
+
+    ~ShaderPermutations()
+    {
+        for (auto& variant : variants)
+            glDeleteProgram(variant.second.ID);
+    }
+
+    ShaderPermutations(const ShaderPermutations&) = delete;
+    ShaderPermutations& operator=(const ShaderPermutations&) = delete;
+
+    // bit of a key, 0 for keys this set does not know
+    // ------------------------------------------------------------------------
+    unsigned int bit(const std::string& key) const
+    {
+        for (size_t i = 0; i < keys.size(); i++)
+            if (keys[i] == key)
+                return 1u << i;
+        std::cout << "ERROR::SHADER::UNKNOWN_PERMUTATION_KEY: " << key << std::endl;
+        return 0;
+    }
+
+    // makes the variant for a mask the one drawn with, compiled on first use
+    // ------------------------------------------------------------------------
+    void use(unsigned int mask)
+    {
+        if (useSpirv)
+            get(mask).use();
+        else
+            pipelines->bind(mask);
+    }
+
+    // The variant as one whole program, compiled and linked on first use. Draw with use, this
+    // is for looking into the program (verifyUniformBlock) and costs a link of its own from GLSL
+    // ------------------------------------------------------------------------
+    Shader& get(unsigned int mask)
+    {
+        auto found = variants.find(mask);
+        if (found != variants.end())
+            return found->second;
+        return variants.emplace(mask, compile(mask)).first->second;
+    }
+
+    // compiles a known set of variants now so the first frame that needs them doesn't hitch
+    // ------------------------------------------------------------------------
+    void precompile(const std::vector<unsigned int>& masks)
+    {
+        for (unsigned int mask : masks)
+        {
+            if (useSpirv)
+                get(mask);
+            else
+                pipelines->get(mask);
+        }
+    }
+
+    // reads the GLSL files again and recompiles every variant compiled so far. Only swaps the
+    // new programs in when all of them compile and link, otherwise the old ones stay in use.
+    // Always uses the GLSL text since edited .txt files make the .spv files out of date
+    // ------------------------------------------------------------------------
+    bool reload()
+    {
+        std::string newVertexSource = preprocessor.expand(vertexPath);
+        std::string newFragmentSource = preprocessor.expand(fragmentPath);
+        if (newVertexSource.empty() || newFragmentSource.empty())
+            return false;
+
+        std::unordered_map<unsigned int, unsigned int> compiled;
+        bool success = true;
+        for (auto& variant : variants)
+        {
+            std::string defines = StagePermutations::definesFor(keys, variant.first);
+            Shader shader = Shader::fromSource(StagePermutations::inject(newVertexSource, defines), StagePermutations::inject(newFragmentSource, defines));
+            compiled[variant.first] = shader.ID;
+            success = success && linked(shader);
+        }
+        // coming from SPIR-V there are no stages yet, they are compiled when first used
+        if (!vertexStages)
+            createStages();
+        bool vertexCompiled = vertexStages->prepare();
+        bool fragmentCompiled = fragmentStages->prepare();
+        success = success && vertexCompiled && fragmentCompiled;
+        if (success)
+        {
+            vertexStages->commit();
+            fragmentStages->commit();
+            // the pipelines still point at the old stages
+            pipelines->clear();
+        }
+        else
+        {
+            vertexStages->discard();
+            fragmentStages->discard();
+        }
+
+        for (auto& variant : variants)
+        {
+            unsigned int& id = variant.second.ID;
+            unsigned int unused = success ? id : compiled[variant.first];
+            if (success)
+                id = compiled[variant.first];
+            glDeleteProgram(unused);
+        }
+        if (success)
+        {
+            vertexSource = newVertexSource;
+            fragmentSource = newFragmentSource;
+            useSpirv = false;
+        }
+        return success;
+    }
+
+    // true while the variants come from the SPIR-V files, keys only GLSL has are off then
+    bool usesSpirv() const { return useSpirv; }
+
+    const std::string& getVertexPath() const { return vertexPath; }
+    const std::string& getFragmentPath() const { return fragmentPath; }
+
+    // every file the GLSL sources pull in through #include, the shader files themselves included
+    // ------------------------------------------------------------------------
+    std::vector<std::string> sourceFiles() const
+    {
+        std::vector<std::string> result = preprocessor.dependencies(vertexPath);
+        for (const std::string& path : preprocessor.dependencies(fragmentPath))
+            if (std::find(result.begin(), result.end(), path) == result.end())
+                result.push_back(path);
+        for (const std::string& path : { vertexPath, fragmentPath })
+            if (std::find(result.begin(), result.end(), path) == result.end())
+                result.push_back(path);
+        return result;
+    }
+
+private:
+    std::vector<std::string> keys;
+    std::string vertexPath;
+    std::string fragmentPath;
+    ShaderPreprocessor& preprocessor;
+    std::string vertexSource;
+    std::string fragmentSource;
+    const char* spirvPaths[2] = {};
+    bool useSpirv = false;
+    std::unordered_map<unsigned int, Shader> variants;
+    std::unique_ptr<StagePermutations> vertexStages;
+    std::unique_ptr<StagePermutations> fragmentStages;
+    std::unique_ptr<PipelineCache> pipelines;
+
+    void createStages()
+    {
+        vertexStages.reset(new StagePermutations(GL_VERTEX_SHADER, vertexPath, keys, preprocessor));
+        fragmentStages.reset(new StagePermutations(GL_FRAGMENT_SHADER, fragmentPath, keys, preprocessor));
+        pipelines.reset(new PipelineCache(*vertexStages, *fragmentStages));
+    }
+
+    Shader compile(unsigned int mask) const
+    {
+        if (useSpirv)
+        {
+            std::vector<SpecializationConstant> constants;
+            for (size_t i = 0; i < keys.size(); i++)
+                constants.push_back({ static_cast<unsigned int>(i), (mask >> i) & 1u });
+            return Shader::fromSpirv(spirvPaths[0], spirvPaths[1], constants);
+        }
+
+        std::string defines = StagePermutations::definesFor(keys, mask);
+        Shader shader = Shader::fromSource(StagePermutations::inject(vertexSource, defines), StagePermutations::inject(fragmentSource, defines));
+        linked(shader);
+        return shader;
+    }
+
+    // errors name sources by number, print which file each number is
+    bool linked(const Shader& shader) const
+    {
+        if (shader.isLinked())
+            return true;
+        std::cout << "Shader source numbers: " << preprocessor.describeSources() << std::endl;
+        return false;
+    }
+};
+
+#endif
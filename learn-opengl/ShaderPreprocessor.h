@@ -0,0 +1,273 @@
+#ifndef SHADER_PREPROCESSOR_H
+#define SHADER_PREPROCESSOR_H
+
+#include "Shaders.h"
+
+#include <cstdint>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Expands #include "file" in shader sources before they go to glShaderSource.
+//
+// - paths are relative to the including file
+// - files with #pragma once or an #ifndef/#define/#endif guard are only pasted in once
+// - #line directives are inserted so compile errors point at the right file and line. GLSL
+//   only takes numbers for the source, use sourceName to turn them back into file names
+// - "#extension GL_GOOGLE_include_directive" lines are removed, shaders keep them so
+//   glslangValidator can expand the same includes when compiling to SPIR-V
+//
+// Every file is read once and kept with a hash of its contents, and expanded sources are
+// cached by that hash, so a header shared by many programs is read and expanded once.
+// Call invalidate when a file changes on disk.
+class ShaderPreprocessor
+{
+public:
+    // the fully expanded source of a file
+    // ------------------------------------------------------------------------
+    std::string expand(const std::string& path)
+    {
+        const SourceFile& root = load(path);
+        auto cached = expanded.find(root.hash);
+        if (cached != expanded.end() && upToDate(cached->second))
+            return cached->second.source;
+
+        Expansion expansion;
+        std::set<std::string> included;
+        std::set<std::string> guards;
+        std::ostringstream out;
+        expandInto(path, out, included, guards, expansion, 0);
+        expansion.source = out.str();
+        expanded[root.hash] = expansion;
+        return expansion.source;
+    }
+
+    // all files path pulls in (itself included), valid after expand
+    // ------------------------------------------------------------------------
+    std::vector<std::string> dependencies(const std::string& path)
+    {
+        std::vector<std::string> result;
+        auto cached = expanded.find(load(path).hash);
+        if (cached != expanded.end())
+            for (auto& dependency : cached->second.dependencies)
+                result.push_back(dependency.first);
+        return result;
+    }
+
+    // the file behind a source string number in a compile error
+    // ------------------------------------------------------------------------
+    std::string sourceName(int number) const
+    {
+        return number >= 0 && number < static_cast<int>(sourceNumbers.size()) ? sourceNumbers[number] : std::string("?");
+    }
+
+    // "0 = VertexShader.txt, 1 = ..." for printing next to compile errors
+    // ------------------------------------------------------------------------
+    std::string describeSources() const
+    {
+        std::string result;
+        for (size_t i = 0; i < sourceNumbers.size(); i++)
+            result += (i ? ", " : "") + std::to_string(i) + " = " + sourceNumbers[i];
+        return result;
+    }
+
+    // forget what was read from path so the next expand reads it again
+    // ------------------------------------------------------------------------
+    void invalidate(const std::string& path)
+    {
+        files.erase(path);
+    }
+
+    // one preprocessor shared by every program so the caches are shared too
+    static ShaderPreprocessor& shared()
+    {
+        static ShaderPreprocessor preprocessor;
+        return preprocessor;
+    }
+
+private:
+    struct SourceFile
+    {
+        std::vector<std::string> lines;
+        uint64_t hash;
+    };
+
+    struct Expansion
+    {
+        std::string source;
+        // every file used and the hash it had at the time
+        std::vector<std::pair<std::string, uint64_t>> dependencies;
+    };
+
+    std::unordered_map<std::string, SourceFile> files;
+    std::unordered_map<uint64_t, Expansion> expanded;
+    std::vector<std::string> sourceNumbers;
+
+    static uint64_t fnv1a(const std::string& text)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : text)
+        {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    const SourceFile& load(const std::string& path)
+    {
+        auto found = files.find(path);
+        if (found != files.end())
+            return found->second;
+
+        std::string text = Shader::readFile(path.c_str());
+        SourceFile file;
+        file.hash = fnv1a(path + '\n' + text);
+        std::istringstream stream(text);
+        std::string line;
+        while (std::getline(stream, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            file.lines.push_back(line);
+        }
+        return files.emplace(path, std::move(file)).first->second;
+    }
+
+    bool upToDate(const Expansion& expansion)
+    {
+        for (auto& dependency : expansion.dependencies)
+            if (load(dependency.first).hash != dependency.second)
+                return false;
+        return true;
+    }
+
+    int sourceNumber(const std::string& path)
+    {
+        for (size_t i = 0; i < sourceNumbers.size(); i++)
+            if (sourceNumbers[i] == path)
+                return static_cast<int>(i);
+        sourceNumbers.push_back(path);
+        return static_cast<int>(sourceNumbers.size()) - 1;
+    }
+
+    // directive name and the rest of the line, or an empty name for normal lines
+    static std::string directive(const std::string& line, std::string& rest)
+    {
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line[start] != '#')
+            return std::string();
+        size_t nameStart = line.find_first_not_of(" \t", start + 1);
+        if (nameStart == std::string::npos)
+            return std::string();
+        size_t nameEnd = line.find_first_of(" \t", nameStart);
+        std::string name = line.substr(nameStart, nameEnd == std::string::npos ? std::string::npos : nameEnd - nameStart);
+        size_t restStart = nameEnd == std::string::npos ? std::string::npos : line.find_first_not_of(" \t", nameEnd);
+        rest = restStart == std::string::npos ? std::string() : line.substr(restStart);
+        while (!rest.empty() && (rest.back() == ' ' || rest.back() == '\t'))
+            rest.pop_back();
+        return name;
+    }
+
+    // name of the #ifndef/#define guard wrapping the whole file, if there is one
+    static std::string includeGuard(const SourceFile& file)
+    {
+        std::vector<std::pair<std::string, std::string>> directives;
+        for (const std::string& line : file.lines)
+        {
+            std::string rest;
+            std::string name = directive(line, rest);
+            if (!name.empty())
+                directives.push_back({ name, rest });
+            else if (directives.size() < 2 && !blankOrComment(line))
+                return std::string();
+        }
+        if (directives.size() < 3 || directives[0].first != "ifndef" || directives[1].first != "define" ||
+            directives[0].second != directives[1].second || directives.back().first != "endif")
+            return std::string();
+        return directives[0].second;
+    }
+
+    static bool blankOrComment(const std::string& line)
+    {
+        size_t start = line.find_first_not_of(" \t");
+        return start == std::string::npos || line.compare(start, 2, "//") == 0;
+    }
+
+    static std::string directoryOf(const std::string& path)
+    {
+        size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+    }
+
+    void expandInto(const std::string& path, std::ostringstream& out, std::set<std::string>& included,
+        std::set<std::string>& guards, Expansion& expansion, int depth)
+    {
+        const SourceFile& file = load(path);
+        expansion.dependencies.push_back({ path, file.hash });
+        if (depth > 32)
+        {
+            std::cout << "ERROR::SHADER::INCLUDE_TOO_DEEP: " << path << std::endl;
+            return;
+        }
+
+        std::string guard = includeGuard(file);
+        if (included.count(path) || (!guard.empty() && guards.count(guard)))
+            return;
+        if (!guard.empty())
+            guards.insert(guard);
+        included.insert(path);
+        int number = sourceNumber(path);
+
+        bool onceOnly = false;
+        for (size_t i = 0; i < file.lines.size(); i++)
+        {
+            const std::string& line = file.lines[i];
+            std::string rest;
+            std::string name = directive(line, rest);
+            if (name == "pragma" && rest == "once")
+            {
+                onceOnly = true;
+                out << "\n";
+                continue;
+            }
+            if (name == "extension" && rest.find("GL_GOOGLE_include_directive") != std::string::npos)
+            {
+                out << "\n";
+                continue;
+            }
+            if (name == "version" && depth == 0)
+            {
+                // the root file has no #line of its own otherwise, errors before its first
+                // include would be reported against source 0
+                out << line << "\n" << "#line " << i + 2 << " " << number << "\n";
+                continue;
+            }
+            if (name == "include")
+            {
+                size_t open = rest.find('"');
+                size_t close = open == std::string::npos ? std::string::npos : rest.find('"', open + 1);
+                if (close == std::string::npos)
+                {
+                    std::cout << "ERROR::SHADER::BAD_INCLUDE: " << path << "(" << i + 1 << "): " << line << std::endl;
+                    out << "\n";
+                    continue;
+                }
+                std::string includePath = directoryOf(path) + rest.substr(open + 1, close - open - 1);
+                out << "#line 1 " << sourceNumber(includePath) << "\n";
+                expandInto(includePath, out, included, guards, expansion, depth + 1);
+                // back in this file on the line after the include
+                out << "#line " << i + 2 << " " << number << "\n";
+                continue;
+            }
+            out << line << "\n";
+        }
+        // files without #pragma once or a guard may be included more than once
+        if (!onceOnly && guard.empty())
+            included.erase(path);
+    }
+};
+
+#endif
@@ -3,10 +3,32 @@
 
 #include <glad/glad.h>
 
+#include <algorithm>
+#include <ctime>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <cstddef>
+#include <vector>
+#include <iterator>
+#include <sys/stat.h>
+
+// name and byte offset of a uniform block member, used to check C++ structs against std140
+struct UniformField
+{
+    const char* name;
+    size_t offset;
+};
+
+#define UNIFORM_FIELD(Block, member) UniformField{ #member, offsetof(Block, member) }
+
+// value for a layout(constant_id = id) constant in a SPIR-V shader
+struct SpecializationConstant
+{
+    unsigned int id;
+    unsigned int value;
+};
 
 class Shader
 {
@@ -17,56 +39,96 @@ public:
     Shader(const char* vertexPath, const char* fragmentPath)
     {
         // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
+        std::string vertexCode = readFile(vertexPath);
+        std::string fragmentCode = readFile(fragmentPath);
+        // 2. compile shaders
+        compile(vertexCode, fragmentCode);
+    }
+    // reads a whole shader file into a string
+    // ------------------------------------------------------------------------
+    static std::string readFile(const char* path)
+    {
+        std::ifstream shaderFile;
         // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        shaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
         try
         {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
+            // open file and read its buffer contents into a stream
+            shaderFile.open(path);
+            std::stringstream shaderStream;
+            shaderStream << shaderFile.rdbuf();
+            shaderFile.close();
             // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
+            return shaderStream.str();
         }
         catch (std::ifstream::failure& e)
         {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << " " << e.what() << std::endl;
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char* fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessary
+        return std::string();
+    }
+    // compiles source that is already in memory
+    // ------------------------------------------------------------------------
+    static Shader fromSource(const std::string& vertexCode, const std::string& fragmentCode)
+    {
+        Shader shader;
+        shader.compile(vertexCode, fragmentCode);
+        return shader;
+    }
+    // loads precompiled SPIR-V (CompileShaders.bat) so the driver skips parsing GLSL.
+    // Each stage only gets the specialization constants it declares
+    // ------------------------------------------------------------------------
+    static Shader fromSpirv(const char* vertexPath, const char* fragmentPath,
+        const std::vector<SpecializationConstant>& constants = {})
+    {
+        Shader shader;
+        unsigned int vertex = shader.loadSpirv(GL_VERTEX_SHADER, vertexPath, constants, "VERTEX");
+        unsigned int fragment = shader.loadSpirv(GL_FRAGMENT_SHADER, fragmentPath, constants, "FRAGMENT");
+        shader.ID = glCreateProgram();
+        glAttachShader(shader.ID, vertex);
+        glAttachShader(shader.ID, fragment);
+        glLinkProgram(shader.ID);
+        shader.checkCompileErrors(shader.ID, "PROGRAM");
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+        return shader;
+    }
+    // True when the driver accepts SPIR-V (GL 4.6) and both binaries exist and are newer than
+    // every file in sources, the GLSL files they were compiled from. An older binary means the
+    // GLSL was edited without recompiling it (CompileShaders.bat skips that without glslang)
+    // ------------------------------------------------------------------------
+    static bool canLoadSpirv(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& sources = std::vector<std::string>())
+    {
+        if (!GLAD_GL_VERSION_4_6)
+            return false;
+        int formatCount = 0;
+        glGetIntegerv(GL_NUM_SHADER_BINARY_FORMATS, &formatCount);
+        std::vector<int> formats(formatCount);
+        if (formatCount > 0)
+            glGetIntegerv(GL_SHADER_BINARY_FORMATS, formats.data());
+        bool spirv = false;
+        for (int format : formats)
+            spirv = spirv || format == GL_SHADER_BINARY_FORMAT_SPIR_V;
+        if (!spirv || !std::ifstream(vertexPath).good() || !std::ifstream(fragmentPath).good())
+            return false;
+        time_t compiled = std::min(modificationTime(vertexPath), modificationTime(fragmentPath));
+        for (const std::string& source : sources)
+        {
+            if (modificationTime(source.c_str()) > compiled)
+            {
+                std::cout << "ERROR::SHADER::SPIRV_OUT_OF_DATE: " << source << " is newer than " << vertexPath << ", using the GLSL" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+    // false when compiling or linking failed
+    // ------------------------------------------------------------------------
+    bool isLinked() const
+    {
+        int success = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        return success != 0;
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -90,8 +152,154 @@ public:
     {
         glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
     }
+    // uniform blocks
+    // ------------------------------------------------------------------------
+    void bindUniformBlock(const std::string& name, unsigned int binding) const
+    {
+        unsigned int index = glGetUniformBlockIndex(ID, name.c_str());
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, binding);
+    }
+    // ------------------------------------------------------------------------
+    // checks that a C++ struct matches the std140 layout the driver reports for a block
+    template <size_t N>
+    bool verifyUniformBlock(const std::string& name, size_t size, const UniformField (&fields)[N]) const
+    {
+        unsigned int index = glGetUniformBlockIndex(ID, name.c_str());
+        if (index == GL_INVALID_INDEX)
+        {
+            std::cout << "ERROR::SHADER::UNIFORM_BLOCK_NOT_FOUND: " << name << std::endl;
+            return false;
+        }
+        int blockSize = 0;
+        glGetActiveUniformBlockiv(ID, index, GL_UNIFORM_BLOCK_DATA_SIZE, &blockSize);
+        bool matches = static_cast<size_t>(blockSize) == size;
+        if (!matches)
+            std::cout << "ERROR::SHADER::UNIFORM_BLOCK_SIZE_MISMATCH: " << name << " is " << blockSize << " bytes, struct is " << size << std::endl;
+
+        int count = 0;
+        glGetActiveUniformBlockiv(ID, index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &count);
+        std::vector<int> indices(count);
+        if (count > 0)
+            glGetActiveUniformBlockiv(ID, index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, indices.data());
+        for (int uniform : indices)
+        {
+            char uniformName[256];
+            glGetActiveUniformName(ID, uniform, sizeof(uniformName), NULL, uniformName);
+            unsigned int uniformIndex = uniform;
+            int offset = 0;
+            glGetActiveUniformsiv(ID, 1, &uniformIndex, GL_UNIFORM_OFFSET, &offset);
+
+            bool found = false;
+            for (const UniformField& field : fields)
+            {
+                if (nameMatches(uniformName, field.name))
+                {
+                    found = true;
+                    if (field.offset != static_cast<size_t>(offset))
+                    {
+                        std::cout << "ERROR::SHADER::UNIFORM_OFFSET_MISMATCH: " << name << "." << uniformName << " is at " << offset << ", struct has it at " << field.offset << std::endl;
+                        matches = false;
+                    }
+                }
+            }
+            if (!found)
+            {
+                std::cout << "ERROR::SHADER::UNIFORM_MISSING_IN_STRUCT: " << name << "." << uniformName << std::endl;
+                matches = false;
+            }
+        }
+        return matches;
+    }
 
 private:
+    Shader() : ID(0)
+    {
+    }
+    // ------------------------------------------------------------------------
+    unsigned int loadSpirv(GLenum type, const char* path, const std::vector<SpecializationConstant>& constants, const std::string& typeName)
+    {
+        std::vector<char> binary;
+        std::ifstream file(path, std::ios::binary);
+        if (file)
+            binary.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        else
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+
+        // glSpecializeShader fails on ids the module does not have, so find the ones it has.
+        // They are OpDecorate (71) instructions with the SpecId (1) decoration
+        std::vector<unsigned int> declared;
+        const unsigned int* words = reinterpret_cast<const unsigned int*>(binary.data());
+        size_t wordCount = binary.size() / 4;
+        for (size_t i = 5; i < wordCount;)
+        {
+            unsigned int length = words[i] >> 16;
+            // a truncated or corrupt module, don't read past its end
+            if (length == 0 || i + length > wordCount)
+                break;
+            if ((words[i] & 0xFFFF) == 71 && length == 4 && words[i + 2] == 1)
+                declared.push_back(words[i + 3]);
+            i += length;
+        }
+
+        std::vector<unsigned int> ids, values;
+        for (const SpecializationConstant& constant : constants)
+        {
+            for (unsigned int id : declared)
+            {
+                if (id == constant.id)
+                {
+                    ids.push_back(constant.id);
+                    values.push_back(constant.value);
+                }
+            }
+        }
+
+        unsigned int shader = glCreateShader(type);
+        glShaderBinary(1, &shader, GL_SHADER_BINARY_FORMAT_SPIR_V, binary.data(), static_cast<GLsizei>(binary.size()));
+        // specializing is the SPIR-V equivalent of glCompileShader
+        glSpecializeShader(shader, "main", static_cast<unsigned int>(ids.size()), ids.data(), values.data());
+        checkCompileErrors(shader, typeName);
+        return shader;
+    }
+    // ------------------------------------------------------------------------
+    void compile(const std::string& vertexCode, const std::string& fragmentCode)
+    {
+        const char* vShaderCode = vertexCode.c_str();
+        const char* fShaderCode = fragmentCode.c_str();
+        unsigned int vertex, fragment;
+        // vertex shader
+        vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glCompileShader(vertex);
+        checkCompileErrors(vertex, "VERTEX");
+        // fragment Shader
+        fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glCompileShader(fragment);
+        checkCompileErrors(fragment, "FRAGMENT");
+        // shader Program
+        ID = glCreateProgram();
+        glAttachShader(ID, vertex);
+        glAttachShader(ID, fragment);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+        // delete the shaders as they're linked into our program now and no longer necessary
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+    }
+    // arrays are reported as "name[0]"
+    // 0 for files that can't be found
+    static time_t modificationTime(const char* path)
+    {
+        struct stat info;
+        return stat(path, &info) == 0 ? info.st_mtime : 0;
+    }
+
+    static bool nameMatches(const std::string& uniformName, const std::string& fieldName)
+    {
+        return uniformName == fieldName || uniformName == fieldName + "[0]";
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(unsigned int shader, std::string type)
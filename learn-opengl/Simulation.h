@@ -0,0 +1,178 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "TripleBuffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Everything the simulation produces for one tick
+struct SimulationState
+{
+    double time = 0.0;
+    // rotation of the first box in radians
+    float rotation = 0.0f;
+    // scale of the second box
+    float scale = 0.0f;
+
+    // ------------------------------------------------------------------------
+    static SimulationState interpolate(const SimulationState& a, const SimulationState& b, float alpha)
+    {
+        SimulationState result;
+        result.time = a.time + (b.time - a.time) * alpha;
+        result.rotation = a.rotation + (b.rotation - a.rotation) * alpha;
+        result.scale = a.scale + (b.scale - a.scale) * alpha;
+        return result;
+    }
+};
+
+// What gets published to the render thread. Holds the last two ticks so the renderer can
+// interpolate between them without ever seeing a mismatched pair.
+struct SimulationSnapshot
+{
+    SimulationState previous;
+    SimulationState current;
+    // when current was published, in seconds on the simulation clock
+    double publishedAt = 0.0;
+};
+
+// Runs the simulation on its own thread at a fixed tick rate, independent of how fast or slow
+// frames are rendered. The render thread calls sample() to get an interpolated state.
+class SimulationThread
+{
+public:
+    // ------------------------------------------------------------------------
+    explicit SimulationThread(double tickRate = 60.0)
+        : tickDuration(1.0 / tickRate), start(Clock::now())
+    {
+        // the render thread can sample before the first tick is published
+        SimulationSnapshot& initial = snapshots.back();
+        step(initial.current, 0.0);
+        initial.previous = initial.current;
+        snapshots.publish();
+        worker = std::thread(&SimulationThread::run, this);
+    }
+
+    ~SimulationThread()
+    {
+        {
+            std::lock_guard<std::mutex> lock(pauseMutex);
+            running = false;
+        }
+        pauseChanged.notify_one();
+        worker.join();
+    }
+
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    // paused simulations stop advancing and the thread sleeps until resumed
+    // ------------------------------------------------------------------------
+    void setPaused(bool value)
+    {
+        {
+            std::lock_guard<std::mutex> lock(pauseMutex);
+            paused = value;
+        }
+        pauseChanged.notify_one();
+    }
+    bool isPaused() const { return paused; }
+
+    // render thread: state interpolated between the last two ticks. Lags at most one tick
+    // behind the simulation, in exchange frames are smooth whatever the tick rate is
+    // ------------------------------------------------------------------------
+    SimulationState sample()
+    {
+        const SimulationSnapshot& snapshot = snapshots.read();
+        double alpha = (seconds() - snapshot.publishedAt) / tickDuration;
+        alpha = alpha < 0.0 ? 0.0 : (alpha > 1.0 ? 1.0 : alpha);
+        if (paused)
+            alpha = 1.0;
+        return SimulationState::interpolate(snapshot.previous, snapshot.current, static_cast<float>(alpha));
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    const double tickDuration;
+    const Clock::time_point start;
+    TripleBuffer<SimulationSnapshot> snapshots;
+    std::thread worker;
+
+    std::mutex pauseMutex;
+    std::condition_variable pauseChanged;
+    std::atomic<bool> paused{ false };
+    bool running = true;
+
+    double seconds() const
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // the actual simulation, what the render loop used to compute inline from glfwGetTime
+    static void step(SimulationState& state, double time)
+    {
+        state.time = time;
+        state.rotation = static_cast<float>(time);
+        state.scale = static_cast<float>(sin(time));
+    }
+
+    void run()
+    {
+        SimulationState state;
+        step(state, 0.0);
+        double simulationTime = 0.0;
+        double accumulator = 0.0;
+        double last = seconds();
+
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(pauseMutex);
+                if (paused && running)
+                {
+                    pauseChanged.wait(lock, [this] { return !paused || !running; });
+                    // time spent paused does not count towards the simulation
+                    last = seconds();
+                }
+                if (!running)
+                    return;
+            }
+
+            double now = seconds();
+            accumulator += now - last;
+            last = now;
+
+            // fixed steps, a hitch gets caught up with several ticks but never more than a quarter second
+            if (accumulator > 0.25)
+                accumulator = 0.25;
+            bool stepped = false;
+            SimulationState previous = state;
+            while (accumulator >= tickDuration)
+            {
+                previous = state;
+                simulationTime += tickDuration;
+                step(state, simulationTime);
+                accumulator -= tickDuration;
+                stepped = true;
+            }
+
+            if (stepped)
+            {
+                SimulationSnapshot& snapshot = snapshots.back();
+                snapshot.previous = previous;
+                snapshot.current = state;
+                snapshot.publishedAt = seconds();
+                snapshots.publish();
+            }
+
+            std::this_thread::sleep_for(std::chrono::duration<double>(tickDuration - accumulator));
+        }
+    }
+};
+
+#endif
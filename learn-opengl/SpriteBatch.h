@@ -0,0 +1,269 @@
+#ifndef SPRITE_BATCH_H
+#define SPRITE_BATCH_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <glm/glm/glm.hpp>
+
+#include "MappedRing.h"
+#include "Shaders.h"
+#include "ShaderPreprocessor.h"
+#include "TextureArray.h"
+
+// One sprite as SpriteVertexShader.txt reads it, all of it is per instance
+struct SpriteInstance
+{
+    // where the origin goes (xy) and the size (zw)
+    float rect[4];
+    // the part of the texture array layer, texture coords are scaled by zw and offset by xy
+    float region[4];
+    // the point placed at the position and rotated around, 0..1 of the size
+    float origin[2];
+    // counter clockwise in radians
+    float rotation;
+    int32_t layer;
+    // RGBA multiplied with the texture
+    uint8_t color[4];
+};
+
+static_assert(sizeof(SpriteInstance) == 52, "SpriteInstance has to match the attributes of SpriteVertexShader.txt");
+
+enum class SpriteBlend : uint8_t
+{
+    Alpha,
+    Additive,
+    Opaque,
+};
+
+// Draws lots of textured quads with few draw calls. Between begin and end every draw writes
+// one SpriteInstance straight into a persistently mapped buffer, the quad's corners are made
+// in the vertex shader from gl_VertexID. Sprites in a row with the same texture array and
+// blend mode become one instanced draw, so a frame of sprites that all come from one
+// TextureArray is a single draw call however many there are. Sprites are drawn in the order
+// they were given, later ones on top.
+//
+// The buffer is a MappedRing with room for capacity sprites in each frame's segment. Call
+// beginFrame and endFrame once per frame around all begin/end pairs of that frame.
+class SpriteBatch
+{
+public:
+    // ------------------------------------------------------------------------
+    explicit SpriteBatch(size_t capacity = 65536, int framesInFlight = 3,
+        const char* vertexPath = "SpriteVertexShader.txt", const char* fragmentPath = "SpriteFragmentShader.txt",
+        ShaderPreprocessor& preprocessor = ShaderPreprocessor::shared())
+        : capacity(capacity),
+        shader(Shader::fromSource(preprocessor.expand(vertexPath), preprocessor.expand(fragmentPath))),
+        instances(capacity * sizeof(SpriteInstance), framesInFlight)
+    {
+        // every attribute is per instance, the draws start at the sprites of their batch with baseInstance
+        glCreateVertexArrays(1, &vertexArray);
+        glVertexArrayVertexBuffer(vertexArray, 0, instances.ID, 0, sizeof(SpriteInstance));
+        glVertexArrayBindingDivisor(vertexArray, 0, 1);
+        attribute(0, 4, GL_FLOAT, GL_FALSE, offsetof(SpriteInstance, rect));
+        attribute(1, 4, GL_FLOAT, GL_FALSE, offsetof(SpriteInstance, region));
+        attribute(2, 3, GL_FLOAT, GL_FALSE, offsetof(SpriteInstance, origin));
+        glVertexArrayAttribIFormat(vertexArray, 3, 1, GL_INT, offsetof(SpriteInstance, layer));
+        glVertexArrayAttribBinding(vertexArray, 3, 0);
+        glEnableVertexArrayAttrib(vertexArray, 3);
+        attribute(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(SpriteInstance, color));
+
+        batches.reserve(64);
+    }
+
+    ~SpriteBatch()
+    {
+        glDeleteVertexArrays(1, &vertexArray);
+        glDeleteProgram(shader.ID);
+    }
+
+    SpriteBatch(const SpriteBatch&) = delete;
+    SpriteBatch& operator=(const SpriteBatch&) = delete;
+
+    bool isSupported() const { return shader.isLinked(); }
+
+    // moves to the next segment, waiting if the GPU is still using it
+    // ------------------------------------------------------------------------
+    void beginFrame()
+    {
+        instances.beginFrame();
+        used = 0;
+    }
+
+    // call after the last end of the frame
+    void endFrame() { instances.endFrame(); }
+
+    // starts collecting sprites, projection takes their positions to clip space
+    // ------------------------------------------------------------------------
+    void begin(const glm::mat4& projection, SpriteBlend blend = SpriteBlend::Alpha)
+    {
+        this->projection = projection;
+        this->blend = blend;
+        batches.clear();
+        dropped = 0;
+    }
+
+    // sprites drawn after this use blend, starts a new batch
+    void setBlend(SpriteBlend value) { blend = value; }
+
+    // adds a sprite from a texture array (TextureArray::ID)
+    // ------------------------------------------------------------------------
+    void draw(unsigned int texture, const SpriteInstance& sprite)
+    {
+        // the buffer is write combined memory, one whole copy is the fastest way to fill it
+        if (SpriteInstance* room = allocate(texture, 1))
+            std::memcpy(room, &sprite, sizeof(SpriteInstance));
+    }
+
+    // Room for count sprites in a row from a texture array, for the caller to fill in, from
+    // several threads if it likes. They are drawn in their order in the room. nullptr when
+    // there isn't room for all of them
+    // ------------------------------------------------------------------------
+    SpriteInstance* allocate(unsigned int texture, size_t count)
+    {
+        if (capacity - used < count)
+        {
+            dropped += count;
+            return nullptr;
+        }
+        if (batches.empty() || batches.back().texture != texture || batches.back().blend != blend)
+            batches.push_back(Batch{ texture, blend, used, 0 });
+        batches.back().count += count;
+        SpriteInstance* room = reinterpret_cast<SpriteInstance*>(instances.data()) + used;
+        used += count;
+        return room;
+    }
+
+    // a region of a texture array at x, y, rotated around its middle
+    // ------------------------------------------------------------------------
+    void draw(const TextureArray& texture, const TextureRegion& region, float x, float y, float width, float height,
+        float rotation = 0.0f, const glm::vec4& color = glm::vec4(1.0f))
+    {
+        draw(texture.ID, sprite(region, x, y, width, height, rotation, color));
+    }
+
+    // the instance of a region at x, y, rotated around its middle, for filling allocated room
+    // ------------------------------------------------------------------------
+    static SpriteInstance sprite(const TextureRegion& region, float x, float y, float width, float height,
+        float rotation = 0.0f, const glm::vec4& color = glm::vec4(1.0f))
+    {
+        SpriteInstance instance;
+        instance.rect[0] = x;
+        instance.rect[1] = y;
+        instance.rect[2] = width;
+        instance.rect[3] = height;
+        instance.region[0] = region.offset[0];
+        instance.region[1] = region.offset[1];
+        instance.region[2] = region.scale[0];
+        instance.region[3] = region.scale[1];
+        instance.origin[0] = 0.5f;
+        instance.origin[1] = 0.5f;
+        instance.rotation = rotation;
+        instance.layer = region.layer;
+        for (int i = 0; i < 4; i++)
+            instance.color[i] = static_cast<uint8_t>(std::min(std::max(color[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+        return instance;
+    }
+
+    // Draws everything since begin, one instanced draw per batch. Turns depth testing off for
+    // them and leaves blending off and depth testing as it was
+    // ------------------------------------------------------------------------
+    void end()
+    {
+        if (dropped > 0)
+            std::cout << "ERROR::SPRITE_BATCH::OUT_OF_ROOM: " << dropped << " sprites dropped, room for " << capacity << " per frame" << std::endl;
+        lastDrawCalls = batches.size();
+        if (batches.empty())
+            return;
+
+        bool depthTest = glIsEnabled(GL_DEPTH_TEST) != GL_FALSE;
+        glDisable(GL_DEPTH_TEST);
+        shader.use();
+        glProgramUniformMatrix4fv(shader.ID, 0, 1, GL_FALSE, &projection[0][0]);
+        glBindVertexArray(vertexArray);
+
+        // the segment's sprites come after those of the earlier segments
+        size_t firstInstance = instances.offset() / sizeof(SpriteInstance);
+        unsigned int boundTexture = 0;
+        bool first = true;
+        SpriteBlend boundBlend = SpriteBlend::Opaque;
+        for (const Batch& batch : batches)
+        {
+            if (first || batch.texture != boundTexture)
+            {
+                glBindTextureUnit(0, batch.texture);
+                boundTexture = batch.texture;
+            }
+            if (first || batch.blend != boundBlend)
+            {
+                applyBlend(batch.blend);
+                boundBlend = batch.blend;
+            }
+            first = false;
+            glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(batch.count),
+                static_cast<GLuint>(firstInstance + batch.first));
+        }
+
+        glDisable(GL_BLEND);
+        if (depthTest)
+            glEnable(GL_DEPTH_TEST);
+        batches.clear();
+    }
+
+    // draw calls the last end made
+    size_t drawCalls() const { return lastDrawCalls; }
+
+private:
+    // sprites [first, first + count) of this frame's segment, drawn with one call
+    struct Batch
+    {
+        unsigned int texture;
+        SpriteBlend blend;
+        size_t first;
+        size_t count;
+    };
+
+    size_t capacity;
+    Shader shader;
+    MappedRing instances;
+    unsigned int vertexArray = 0;
+    size_t used = 0;
+    size_t dropped = 0;
+    size_t lastDrawCalls = 0;
+    glm::mat4 projection = glm::mat4(1.0f);
+    SpriteBlend blend = SpriteBlend::Alpha;
+    std::vector<Batch> batches;
+
+    void attribute(unsigned int location, int size, GLenum type, GLboolean normalized, size_t offset)
+    {
+        glVertexArrayAttribFormat(vertexArray, location, size, type, normalized, static_cast<unsigned int>(offset));
+        glVertexArrayAttribBinding(vertexArray, location, 0);
+        glEnableVertexArrayAttrib(vertexArray, location);
+    }
+
+    static void applyBlend(SpriteBlend blend)
+    {
+        switch (blend)
+        {
+        case SpriteBlend::Alpha:
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            break;
+        case SpriteBlend::Additive:
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+            break;
+        case SpriteBlend::Opaque:
+            glDisable(GL_BLEND);
+            break;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,319 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "JobSystem.h"
+#include "stb_image.h"
+
+// Where a texture ended up: the layer of the array and the part of it, as what texture coords
+// are multiplied by and then offset by
+struct TextureRegion
+{
+    int layer = -1;
+    float offset[2] = { 0.0f, 0.0f };
+    float scale[2] = { 1.0f, 1.0f };
+
+    bool valid() const { return layer >= 0; }
+
+    // changes texture coords of the whole texture into coords of the region, for baking the
+    // region into a mesh (Mesh::texCoords) so the shader needs no remapping
+    // ------------------------------------------------------------------------
+    void remap(std::vector<float>& texCoords) const
+    {
+        for (size_t i = 0; i + 1 < texCoords.size(); i += 2)
+        {
+            texCoords[i] = texCoords[i] * scale[0] + offset[0];
+            texCoords[i + 1] = texCoords[i + 1] * scale[1] + offset[1];
+        }
+    }
+};
+
+// Places rectangles in a square, MaxRects with the best short side fit rule (Jylanki, "A
+// Thousand Ways to Pack the Bin"). Keeps every maximal free rectangle, each new one goes where
+// it leaves the smallest leftover along its shorter side.
+class MaxRectsPacker
+{
+public:
+    struct Rect
+    {
+        int x, y, width, height;
+    };
+
+    // ------------------------------------------------------------------------
+    explicit MaxRectsPacker(int size)
+    {
+        free.push_back(Rect{ 0, 0, size, size });
+    }
+
+    // false when there is no room left
+    // ------------------------------------------------------------------------
+    bool insert(int width, int height, Rect& placed)
+    {
+        int bestShort = INT_MAX, bestLong = INT_MAX;
+        for (const Rect& space : free)
+        {
+            if (space.width < width || space.height < height)
+                continue;
+            int leftoverX = space.width - width, leftoverY = space.height - height;
+            int shortSide = std::min(leftoverX, leftoverY), longSide = std::max(leftoverX, leftoverY);
+            if (shortSide < bestShort || (shortSide == bestShort && longSide < bestLong))
+            {
+                placed = Rect{ space.x, space.y, width, height };
+                bestShort = shortSide;
+                bestLong = longSide;
+            }
+        }
+        if (bestShort == INT_MAX)
+            return false;
+
+        // every free rectangle the new one overlaps is split into the up to four parts around it
+        std::vector<Rect> next;
+        for (const Rect& space : free)
+        {
+            if (placed.x >= space.x + space.width || placed.x + placed.width <= space.x ||
+                placed.y >= space.y + space.height || placed.y + placed.height <= space.y)
+            {
+                next.push_back(space);
+                continue;
+            }
+            if (placed.x > space.x)
+                next.push_back(Rect{ space.x, space.y, placed.x - space.x, space.height });
+            if (placed.x + placed.width < space.x + space.width)
+                next.push_back(Rect{ placed.x + placed.width, space.y, space.x + space.width - placed.x - placed.width, space.height });
+            if (placed.y > space.y)
+                next.push_back(Rect{ space.x, space.y, space.width, placed.y - space.y });
+            if (placed.y + placed.height < space.y + space.height)
+                next.push_back(Rect{ space.x, placed.y + placed.height, space.width, space.y + space.height - placed.y - placed.height });
+        }
+        // drop the ones inside another, they add nothing
+        free.clear();
+        for (size_t i = 0; i < next.size(); i++)
+        {
+            bool contained = false;
+            for (size_t j = 0; j < next.size() && !contained; j++)
+                contained = i != j && inside(next[i], next[j]) && (!inside(next[j], next[i]) || j < i);
+            if (!contained)
+                free.push_back(next[i]);
+        }
+        return true;
+    }
+
+private:
+    std::vector<Rect> free;
+
+    static bool inside(const Rect& a, const Rect& b)
+    {
+        return a.x >= b.x && a.y >= b.y && a.x + a.width <= b.x + b.width && a.y + a.height <= b.y + b.height;
+    }
+};
+
+// RGBA8 textures of one size class packed into a single GL_TEXTURE_2D_ARRAY, so draws with
+// different textures can share one binding and be merged: a draw picks its texture with a
+// layer index (and region) instead of a glBindTexture.
+//
+// Textures of exactly the layer size get a layer each and keep working with GL_REPEAT. Smaller
+// ones are packed together into shared layers (MaxRectsPacker) with their edge pixels repeated
+// into a padding border, so filtering and the first few mip levels don't bleed in neighbours;
+// their texture coords have to stay in 0..1. Make one array per size class of textures.
+class TextureArray
+{
+public:
+    unsigned int ID = 0;
+
+    // ------------------------------------------------------------------------
+    explicit TextureArray(int layerSize = 1024, int padding = 4)
+        : layerSize(layerSize), padding(padding)
+    {
+    }
+
+    ~TextureArray()
+    {
+        if (ID)
+            glDeleteTextures(1, &ID);
+    }
+
+    TextureArray(const TextureArray&) = delete;
+    TextureArray& operator=(const TextureArray&) = delete;
+
+    // copies an image (1 to 4 channels, 8 bits each, like stbi_load gives) into the array,
+    // it is on the GPU after the next upload
+    // ------------------------------------------------------------------------
+    TextureRegion add(const unsigned char* pixels, int width, int height, int channels)
+    {
+        TextureRegion region;
+        if (width > layerSize || height > layerSize || width <= 0 || height <= 0)
+        {
+            std::cout << "ERROR::TEXTURE_ARRAY::IMAGE_DOES_NOT_FIT: " << width << "x" << height << " in " << layerSize << "x" << layerSize << std::endl;
+            return region;
+        }
+
+        int x = 0, y = 0;
+        int border = 0;
+        if (width == layerSize && height == layerSize)
+        {
+            region.layer = newLayer();
+        }
+        else
+        {
+            border = padding;
+            MaxRectsPacker::Rect placed;
+            int paddedWidth = std::min(width + 2 * border, layerSize), paddedHeight = std::min(height + 2 * border, layerSize);
+            for (size_t i = 0; i < packers.size() && !region.valid(); i++)
+                if (packers[i].packer.insert(paddedWidth, paddedHeight, placed))
+                    region.layer = packers[i].layer;
+            if (!region.valid())
+            {
+                packers.push_back(SharedLayer{ newLayer(), MaxRectsPacker(layerSize) });
+                packers.back().packer.insert(paddedWidth, paddedHeight, placed);
+                region.layer = packers.back().layer;
+            }
+            // a texture that only fits without its border gets as much of it as there is room for
+            border = std::min(border, std::min((paddedWidth - width) / 2, (paddedHeight - height) / 2));
+            x = placed.x + border;
+            y = placed.y + border;
+        }
+
+        // the image and its border, border texels repeat the nearest edge texel
+        unsigned char* layer = &texels[static_cast<size_t>(region.layer) * layerSize * layerSize * 4];
+        for (int row = -border; row < height + border; row++)
+        {
+            int sourceRow = std::min(std::max(row, 0), height - 1);
+            for (int column = -border; column < width + border; column++)
+            {
+                int sourceColumn = std::min(std::max(column, 0), width - 1);
+                const unsigned char* source = pixels + (static_cast<size_t>(sourceRow) * width + sourceColumn) * channels;
+                unsigned char* destination = layer + (static_cast<size_t>(y + row) * layerSize + x + column) * 4;
+                expand(source, channels, destination);
+            }
+        }
+
+        region.offset[0] = static_cast<float>(x) / layerSize;
+        region.offset[1] = static_cast<float>(y) / layerSize;
+        region.scale[0] = static_cast<float>(width) / layerSize;
+        region.scale[1] = static_cast<float>(height) / layerSize;
+        return region;
+    }
+
+    // loads an image file with stb_image and adds it
+    // ------------------------------------------------------------------------
+    TextureRegion load(const char* path)
+    {
+        int width, height, channels;
+        unsigned char* data = stbi_load(path, &width, &height, &channels, 0);
+        if (!data)
+        {
+            std::cout << "ERROR::TEXTURE_ARRAY::FILE_NOT_LOADED: " << path << std::endl;
+            return TextureRegion();
+        }
+        TextureRegion region = add(data, width, height, channels);
+        stbi_image_free(data);
+        return region;
+    }
+
+    // Loads several image files, decoding them in parallel on the job system. They are added in
+    // order once all are decoded, so they are packed the same as when loaded one by one
+    // ------------------------------------------------------------------------
+    void load(const char* const* paths, size_t count, TextureRegion* regions, JobSystem& jobs = JobSystem::shared())
+    {
+        struct Decoded
+        {
+            unsigned char* data;
+            int width, height, channels;
+        };
+        std::vector<Decoded> images(count);
+        jobs.parallelFor(count, 1, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+                images[i].data = stbi_load(paths[i], &images[i].width, &images[i].height, &images[i].channels, 0);
+        });
+        for (size_t i = 0; i < count; i++)
+        {
+            if (!images[i].data)
+            {
+                std::cout << "ERROR::TEXTURE_ARRAY::FILE_NOT_LOADED: " << paths[i] << std::endl;
+                regions[i] = TextureRegion();
+                continue;
+            }
+            regions[i] = add(images[i].data, images[i].width, images[i].height, images[i].channels);
+            stbi_image_free(images[i].data);
+        }
+    }
+
+    // (re)creates the GL texture from everything added so far, with a full mip chain
+    // ------------------------------------------------------------------------
+    void upload(GLenum wrap = GL_REPEAT, GLenum minFilter = GL_LINEAR_MIPMAP_LINEAR, GLenum magFilter = GL_LINEAR)
+    {
+        if (ID)
+            glDeleteTextures(1, &ID);
+        ID = 0;
+        if (layerCount == 0)
+            return;
+        int levels = 1;
+        while ((layerSize >> levels) > 0)
+            levels++;
+        glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &ID);
+        glTextureStorage3D(ID, levels, GL_RGBA8, layerSize, layerSize, layerCount);
+        glTextureSubImage3D(ID, 0, 0, 0, 0, layerSize, layerSize, layerCount, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+        glGenerateTextureMipmap(ID);
+        glTextureParameteri(ID, GL_TEXTURE_WRAP_S, wrap);
+        glTextureParameteri(ID, GL_TEXTURE_WRAP_T, wrap);
+        glTextureParameteri(ID, GL_TEXTURE_MIN_FILTER, minFilter);
+        glTextureParameteri(ID, GL_TEXTURE_MAG_FILTER, magFilter);
+    }
+
+    // one call for every texture in the array
+    void bind(unsigned int unit) const
+    {
+        glBindTextureUnit(unit, ID);
+    }
+
+    int layers() const { return layerCount; }
+    int size() const { return layerSize; }
+
+    // drops the CPU copy once uploaded, nothing can be added after this
+    void releaseTexels()
+    {
+        std::vector<unsigned char>().swap(texels);
+        packers.clear();
+    }
+
+private:
+    struct SharedLayer
+    {
+        int layer;
+        MaxRectsPacker packer;
+    };
+
+    int layerSize;
+    int padding;
+    int layerCount = 0;
+    std::vector<unsigned char> texels;
+    std::vector<SharedLayer> packers;
+
+    int newLayer()
+    {
+        texels.resize(static_cast<size_t>(layerCount + 1) * layerSize * layerSize * 4, 0);
+        return layerCount++;
+    }
+
+    // grey, grey + alpha, RGB and RGBA to RGBA
+    static void expand(const unsigned char* source, int channels, unsigned char* destination)
+    {
+        switch (channels)
+        {
+        case 1: destination[0] = destination[1] = destination[2] = source[0]; destination[3] = 255; break;
+        case 2: destination[0] = destination[1] = destination[2] = source[0]; destination[3] = source[1]; break;
+        case 3: std::memcpy(destination, source, 3); destination[3] = 255; break;
+        default: std::memcpy(destination, source, 4); break;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,488 @@
+#ifndef TEXTURE_SAMPLER_H
+#define TEXTURE_SAMPLER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Pick the widest instruction set the compiler lets us use. Every x64 CPU we run on has SSE4.1
+// so MSVC gets that path by default, build with /arch:AVX2 to get real hardware gathers.
+#if defined(__AVX2__)
+#define TEXTURE_SAMPLER_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE4_1__) || defined(__AVX__) || (defined(_MSC_VER) && defined(_M_X64))
+#define TEXTURE_SAMPLER_SSE41 1
+#include <smmintrin.h>
+#endif
+
+// CPU side copy of the sampler state we set with glTexParameteri
+enum class SamplerWrap { Repeat, MirroredRepeat, ClampToEdge };
+enum class SamplerFilter { Nearest, Linear };
+enum class SamplerMipmap { None, Nearest, Linear };
+
+struct SamplerState
+{
+    SamplerFilter minFilter = SamplerFilter::Linear;
+    SamplerFilter magFilter = SamplerFilter::Linear;
+    SamplerMipmap mipmap = SamplerMipmap::None;
+    SamplerWrap wrapS = SamplerWrap::Repeat;
+    SamplerWrap wrapT = SamplerWrap::Repeat;
+
+    // builds the state from the same enums we pass to glTexParameteri
+    // ------------------------------------------------------------------------
+    static SamplerState fromGL(GLenum wrapS, GLenum wrapT, GLenum minFilter, GLenum magFilter)
+    {
+        SamplerState state;
+        state.wrapS = wrapFromGL(wrapS);
+        state.wrapT = wrapFromGL(wrapT);
+        state.magFilter = magFilter == GL_NEAREST ? SamplerFilter::Nearest : SamplerFilter::Linear;
+        switch (minFilter)
+        {
+        case GL_NEAREST: state.minFilter = SamplerFilter::Nearest; state.mipmap = SamplerMipmap::None; break;
+        case GL_LINEAR: state.minFilter = SamplerFilter::Linear; state.mipmap = SamplerMipmap::None; break;
+        case GL_NEAREST_MIPMAP_NEAREST: state.minFilter = SamplerFilter::Nearest; state.mipmap = SamplerMipmap::Nearest; break;
+        case GL_LINEAR_MIPMAP_NEAREST: state.minFilter = SamplerFilter::Linear; state.mipmap = SamplerMipmap::Nearest; break;
+        case GL_NEAREST_MIPMAP_LINEAR: state.minFilter = SamplerFilter::Nearest; state.mipmap = SamplerMipmap::Linear; break;
+        default: state.minFilter = SamplerFilter::Linear; state.mipmap = SamplerMipmap::Linear; break;
+        }
+        return state;
+    }
+
+private:
+    static SamplerWrap wrapFromGL(GLenum wrap)
+    {
+        if (wrap == GL_MIRRORED_REPEAT)
+            return SamplerWrap::MirroredRepeat;
+        if (wrap == GL_CLAMP_TO_EDGE || wrap == GL_CLAMP_TO_BORDER)
+            return SamplerWrap::ClampToEdge;
+        return SamplerWrap::Repeat;
+    }
+};
+
+// RGBA8 texture with a full mip chain, stored in 4x4 texel tiles so that the four taps of a
+// bilinear lookup (and most neighbouring lookups) land in the same 64 byte cache line.
+// Texels are packed as r | g << 8 | b << 16 | a << 24.
+class TiledTexture
+{
+public:
+    static const int TileSize = 4;
+    static const int MaxLevels = 16;
+
+    // takes the same data stbi_load gives us (1 to 4 channels, 8 bits each)
+    // ------------------------------------------------------------------------
+    TiledTexture(const unsigned char* data, int width, int height, int channels, bool generateMipmaps = true)
+    {
+        std::vector<uint32_t> linear(static_cast<size_t>(width) * height);
+        for (size_t i = 0; i < linear.size(); i++)
+        {
+            const unsigned char* texel = data + i * channels;
+            uint32_t r = texel[0];
+            uint32_t g = channels > 1 ? texel[1] : r;
+            uint32_t b = channels > 2 ? texel[2] : r;
+            uint32_t a = channels == 2 ? texel[1] : (channels > 3 ? texel[3] : 255);
+            if (channels == 2)
+                g = b = r;
+            linear[i] = r | (g << 8) | (b << 16) | (a << 24);
+        }
+
+        levelCount = 0;
+        while (true)
+        {
+            addLevel(linear, width, height);
+            if (!generateMipmaps || levelCount == MaxLevels || (width == 1 && height == 1))
+                break;
+            linear = downsample(linear, width, height);
+            width = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+        }
+    }
+
+    int levels() const { return levelCount; }
+    int width(int level = 0) const { return levelWidth[level]; }
+    int height(int level = 0) const { return levelHeight[level]; }
+
+    // unfiltered read of a single texel, coordinates must already be in range
+    // ------------------------------------------------------------------------
+    uint32_t texel(int level, int x, int y) const
+    {
+        return texels[address(levelOffset[level], levelTilesX[level], x, y)];
+    }
+
+    static int address(int offset, int tilesX, int x, int y)
+    {
+        return offset + (((y >> 2) * tilesX + (x >> 2)) << 4) + ((y & 3) << 2) + (x & 3);
+    }
+
+private:
+    friend class TextureSampler;
+
+    std::vector<uint32_t> texels;
+    int levelCount;
+    // kept as plain int32 tables so the vector path can gather per lane level info
+    int32_t levelOffset[MaxLevels] = {};
+    int32_t levelWidth[MaxLevels] = {};
+    int32_t levelHeight[MaxLevels] = {};
+    int32_t levelTilesX[MaxLevels] = {};
+
+    void addLevel(const std::vector<uint32_t>& linear, int width, int height)
+    {
+        int tilesX = (width + TileSize - 1) / TileSize;
+        int tilesY = (height + TileSize - 1) / TileSize;
+        int offset = static_cast<int>(texels.size());
+        texels.resize(texels.size() + static_cast<size_t>(tilesX) * tilesY * TileSize * TileSize, 0);
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++)
+                texels[address(offset, tilesX, x, y)] = linear[static_cast<size_t>(y) * width + x];
+
+        levelOffset[levelCount] = offset;
+        levelWidth[levelCount] = width;
+        levelHeight[levelCount] = height;
+        levelTilesX[levelCount] = tilesX;
+        levelCount++;
+    }
+
+    // 2x2 box filter, same as what glGenerateMipmap does on most drivers
+    static std::vector<uint32_t> downsample(const std::vector<uint32_t>& src, int width, int height)
+    {
+        int newWidth = std::max(width / 2, 1);
+        int newHeight = std::max(height / 2, 1);
+        std::vector<uint32_t> dst(static_cast<size_t>(newWidth) * newHeight);
+        for (int y = 0; y < newHeight; y++)
+        {
+            int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+            for (int x = 0; x < newWidth; x++)
+            {
+                int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+                uint32_t taps[4] = {
+                    src[static_cast<size_t>(y0) * width + x0], src[static_cast<size_t>(y0) * width + x1],
+                    src[static_cast<size_t>(y1) * width + x0], src[static_cast<size_t>(y1) * width + x1] };
+                uint32_t result = 0;
+                for (int shift = 0; shift < 32; shift += 8)
+                {
+                    uint32_t sum = 2;
+                    for (uint32_t tap : taps)
+                        sum += (tap >> shift) & 0xFF;
+                    result |= (sum / 4) << shift;
+                }
+                dst[static_cast<size_t>(y) * newWidth + x] = result;
+            }
+        }
+        return dst;
+    }
+};
+
+#if defined(TEXTURE_SAMPLER_AVX2) || defined(TEXTURE_SAMPLER_SSE41)
+namespace texture_sampler_detail
+{
+    // 8 lanes of floats/ints. One register on AVX2, two SSE registers otherwise
+#if defined(TEXTURE_SAMPLER_AVX2)
+    struct Vf { __m256 v; };
+    struct Vi { __m256i v; };
+
+    inline Vf load(const float* p) { return { _mm256_loadu_ps(p) }; }
+    inline void store(float* p, Vf a) { _mm256_storeu_ps(p, a.v); }
+    inline Vf set1(float f) { return { _mm256_set1_ps(f) }; }
+    inline Vi set1i(int i) { return { _mm256_set1_epi32(i) }; }
+    inline Vf operator+(Vf a, Vf b) { return { _mm256_add_ps(a.v, b.v) }; }
+    inline Vf operator-(Vf a, Vf b) { return { _mm256_sub_ps(a.v, b.v) }; }
+    inline Vf operator*(Vf a, Vf b) { return { _mm256_mul_ps(a.v, b.v) }; }
+    inline Vf operator/(Vf a, Vf b) { return { _mm256_div_ps(a.v, b.v) }; }
+    inline Vf vmin(Vf a, Vf b) { return { _mm256_min_ps(a.v, b.v) }; }
+    inline Vf vmax(Vf a, Vf b) { return { _mm256_max_ps(a.v, b.v) }; }
+    inline Vf vfloor(Vf a) { return { _mm256_floor_ps(a.v) }; }
+    inline Vf vceil(Vf a) { return { _mm256_ceil_ps(a.v) }; }
+    inline Vf cmple(Vf a, Vf b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+    inline Vf cmpge(Vf a, Vf b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+    inline Vf cmpgt(Vf a, Vf b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+    inline Vf select(Vf mask, Vf a, Vf b) { return { _mm256_blendv_ps(b.v, a.v, mask.v) }; }
+    inline int movemask(Vf a) { return _mm256_movemask_ps(a.v); }
+    inline Vi toInt(Vf a) { return { _mm256_cvttps_epi32(a.v) }; }
+    inline Vf toFloat(Vi a) { return { _mm256_cvtepi32_ps(a.v) }; }
+    inline Vi operator+(Vi a, Vi b) { return { _mm256_add_epi32(a.v, b.v) }; }
+    inline Vi operator*(Vi a, Vi b) { return { _mm256_mullo_epi32(a.v, b.v) }; }
+    inline Vi operator&(Vi a, Vi b) { return { _mm256_and_si256(a.v, b.v) }; }
+    inline Vi shr(Vi a, int n) { return { _mm256_srli_epi32(a.v, n) }; }
+    inline Vi shl(Vi a, int n) { return { _mm256_slli_epi32(a.v, n) }; }
+    inline Vi gather(const int32_t* base, Vi index) { return { _mm256_i32gather_epi32(reinterpret_cast<const int*>(base), index.v, 4) }; }
+#else
+    struct Vf { __m128 lo, hi; };
+    struct Vi { __m128i lo, hi; };
+
+    inline Vf load(const float* p) { return { _mm_loadu_ps(p), _mm_loadu_ps(p + 4) }; }
+    inline void store(float* p, Vf a) { _mm_storeu_ps(p, a.lo); _mm_storeu_ps(p + 4, a.hi); }
+    inline Vf set1(float f) { return { _mm_set1_ps(f), _mm_set1_ps(f) }; }
+    inline Vi set1i(int i) { return { _mm_set1_epi32(i), _mm_set1_epi32(i) }; }
+    inline Vf operator+(Vf a, Vf b) { return { _mm_add_ps(a.lo, b.lo), _mm_add_ps(a.hi, b.hi) }; }
+    inline Vf operator-(Vf a, Vf b) { return { _mm_sub_ps(a.lo, b.lo), _mm_sub_ps(a.hi, b.hi) }; }
+    inline Vf operator*(Vf a, Vf b) { return { _mm_mul_ps(a.lo, b.lo), _mm_mul_ps(a.hi, b.hi) }; }
+    inline Vf operator/(Vf a, Vf b) { return { _mm_div_ps(a.lo, b.lo), _mm_div_ps(a.hi, b.hi) }; }
+    inline Vf vmin(Vf a, Vf b) { return { _mm_min_ps(a.lo, b.lo), _mm_min_ps(a.hi, b.hi) }; }
+    inline Vf vmax(Vf a, Vf b) { return { _mm_max_ps(a.lo, b.lo), _mm_max_ps(a.hi, b.hi) }; }
+    inline Vf vfloor(Vf a) { return { _mm_floor_ps(a.lo), _mm_floor_ps(a.hi) }; }
+    inline Vf vceil(Vf a) { return { _mm_ceil_ps(a.lo), _mm_ceil_ps(a.hi) }; }
+    inline Vf cmple(Vf a, Vf b) { return { _mm_cmple_ps(a.lo, b.lo), _mm_cmple_ps(a.hi, b.hi) }; }
+    inline Vf cmpge(Vf a, Vf b) { return { _mm_cmpge_ps(a.lo, b.lo), _mm_cmpge_ps(a.hi, b.hi) }; }
+    inline Vf cmpgt(Vf a, Vf b) { return { _mm_cmpgt_ps(a.lo, b.lo), _mm_cmpgt_ps(a.hi, b.hi) }; }
+    inline Vf select(Vf mask, Vf a, Vf b) { return { _mm_blendv_ps(b.lo, a.lo, mask.lo), _mm_blendv_ps(b.hi, a.hi, mask.hi) }; }
+    inline int movemask(Vf a) { return _mm_movemask_ps(a.lo) | (_mm_movemask_ps(a.hi) << 4); }
+    inline Vi toInt(Vf a) { return { _mm_cvttps_epi32(a.lo), _mm_cvttps_epi32(a.hi) }; }
+    inline Vf toFloat(Vi a) { return { _mm_cvtepi32_ps(a.lo), _mm_cvtepi32_ps(a.hi) }; }
+    inline Vi operator+(Vi a, Vi b) { return { _mm_add_epi32(a.lo, b.lo), _mm_add_epi32(a.hi, b.hi) }; }
+    inline Vi operator*(Vi a, Vi b) { return { _mm_mullo_epi32(a.lo, b.lo), _mm_mullo_epi32(a.hi, b.hi) }; }
+    inline Vi operator&(Vi a, Vi b) { return { _mm_and_si128(a.lo, b.lo), _mm_and_si128(a.hi, b.hi) }; }
+    inline Vi shr(Vi a, int n) { return { _mm_srli_epi32(a.lo, n), _mm_srli_epi32(a.hi, n) }; }
+    inline Vi shl(Vi a, int n) { return { _mm_slli_epi32(a.lo, n), _mm_slli_epi32(a.hi, n) }; }
+    // SSE has no gather so the loads are done one lane at a time
+    inline Vi gather(const int32_t* base, Vi index)
+    {
+        alignas(16) int32_t lanes[8];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), index.lo);
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes + 4), index.hi);
+        return { _mm_setr_epi32(base[lanes[0]], base[lanes[1]], base[lanes[2]], base[lanes[3]]),
+                 _mm_setr_epi32(base[lanes[4]], base[lanes[5]], base[lanes[6]], base[lanes[7]]) };
+    }
+#endif
+}
+#endif
+
+// Replicates GL texture sampling on the CPU: nearest/bilinear/trilinear filtering, mip selection
+// from a level of detail and repeat/mirrored repeat/clamp to edge wrapping. sample8 is the hot
+// path and processes 8 lookups per call, sample is the scalar reference it is checked against.
+class TextureSampler
+{
+public:
+    TextureSampler(const TiledTexture& texture, const SamplerState& state)
+        : texture(texture), state(state)
+    {
+    }
+
+    // level of detail from screen space uv derivatives, like the GL spec does it
+    // ------------------------------------------------------------------------
+    static float computeLod(float dudx, float dvdx, float dudy, float dvdy, int width, int height)
+    {
+        float x = (dudx * dudx) * width * width + (dvdx * dvdx) * height * height;
+        float y = (dudy * dudy) * width * width + (dvdy * dvdy) * height * height;
+        return 0.5f * std::log2(std::max(std::max(x, y), 1e-20f));
+    }
+
+    // samples a single coordinate, writes rgba in the 0-1 range
+    // ------------------------------------------------------------------------
+    void sample(float u, float v, float lod, float out[4]) const
+    {
+        bool linear = lod <= 0.0f ? state.magFilter == SamplerFilter::Linear : state.minFilter == SamplerFilter::Linear;
+        float maxLevel = static_cast<float>(texture.levelCount - 1);
+        float clamped = std::min(std::max(lod, 0.0f), maxLevel);
+        int level0 = 0, level1 = 0;
+        float frac = 0.0f;
+        if (state.mipmap == SamplerMipmap::Nearest)
+        {
+            level0 = level1 = static_cast<int>(std::max(std::ceil(clamped + 0.5f) - 1.0f, 0.0f));
+        }
+        else if (state.mipmap == SamplerMipmap::Linear)
+        {
+            float base = std::floor(clamped);
+            level0 = static_cast<int>(base);
+            level1 = std::min(level0 + 1, texture.levelCount - 1);
+            frac = clamped - base;
+        }
+
+        bilinear(level0, u, v, linear, out);
+        if (frac > 0.0f)
+        {
+            float second[4];
+            bilinear(level1, u, v, linear, second);
+            for (int c = 0; c < 4; c++)
+                out[c] = out[c] + (second[c] - out[c]) * frac;
+        }
+    }
+
+    // samples 8 coordinates at once. lod may be null (treated as 0).
+    // out is laid out as structure of arrays: r[8], g[8], b[8], a[8]
+    // ------------------------------------------------------------------------
+    void sample8(const float* u, const float* v, const float* lod, float* out) const
+    {
+#if defined(TEXTURE_SAMPLER_AVX2) || defined(TEXTURE_SAMPLER_SSE41)
+        using namespace texture_sampler_detail;
+        Vf vu = load(u), vv = load(v);
+        Vf vlod = lod ? load(lod) : set1(0.0f);
+        Vf zero = set1(0.0f);
+
+        // magnifying lanes use the mag filter, the rest use the min filter
+        Vf magLinear = set1(state.magFilter == SamplerFilter::Linear ? 1.0f : 0.0f);
+        Vf minLinear = set1(state.minFilter == SamplerFilter::Linear ? 1.0f : 0.0f);
+        Vf linear = select(cmple(vlod, zero), magLinear, minLinear);
+
+        Vf clamped = vmin(vmax(vlod, zero), set1(static_cast<float>(texture.levelCount - 1)));
+        Vi level0 = set1i(0), level1 = set1i(0);
+        Vf frac = zero;
+        if (state.mipmap == SamplerMipmap::Nearest)
+        {
+            level0 = level1 = toInt(vmax(vceil(clamped + set1(0.5f)) - set1(1.0f), zero));
+        }
+        else if (state.mipmap == SamplerMipmap::Linear)
+        {
+            Vf base = vfloor(clamped);
+            level0 = toInt(base);
+            level1 = toInt(vmin(base + set1(1.0f), set1(static_cast<float>(texture.levelCount - 1))));
+            frac = clamped - base;
+        }
+
+        Vf color[4];
+        bilinear8(level0, vu, vv, linear, color);
+        if (movemask(cmpgt(frac, zero)))
+        {
+            Vf second[4];
+            bilinear8(level1, vu, vv, linear, second);
+            for (int c = 0; c < 4; c++)
+                color[c] = color[c] + (second[c] - color[c]) * frac;
+        }
+        for (int c = 0; c < 4; c++)
+            store(out + c * 8, color[c]);
+#else
+        for (int i = 0; i < 8; i++)
+        {
+            float texel[4];
+            sample(u[i], v[i], lod ? lod[i] : 0.0f, texel);
+            for (int c = 0; c < 4; c++)
+                out[c * 8 + i] = texel[c];
+        }
+#endif
+    }
+
+    // samples count coordinates, out gets count rgba values interleaved like a framebuffer
+    // ------------------------------------------------------------------------
+    void sampleMany(const float* u, const float* v, const float* lod, float* out, size_t count) const
+    {
+        float soa[32];
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            sample8(u + i, v + i, lod ? lod + i : nullptr, soa);
+            for (int lane = 0; lane < 8; lane++)
+                for (int c = 0; c < 4; c++)
+                    out[(i + lane) * 4 + c] = soa[c * 8 + lane];
+        }
+        for (; i < count; i++)
+            sample(u[i], v[i], lod ? lod[i] : 0.0f, out + i * 4);
+    }
+
+private:
+    const TiledTexture& texture;
+    SamplerState state;
+
+    static float wrap(float coord, float size, SamplerWrap mode)
+    {
+        if (mode == SamplerWrap::Repeat)
+        {
+            coord -= size * std::floor(coord / size);
+        }
+        else if (mode == SamplerWrap::MirroredRepeat)
+        {
+            coord -= 2.0f * size * std::floor(coord / (2.0f * size));
+            if (coord >= size)
+                coord = 2.0f * size - 1.0f - coord;
+        }
+        // float rounding can push repeat/mirror one past the edge, so always clamp
+        return std::min(std::max(coord, 0.0f), size - 1.0f);
+    }
+
+    void bilinear(int level, float u, float v, bool linear, float out[4]) const
+    {
+        float width = static_cast<float>(texture.levelWidth[level]);
+        float height = static_cast<float>(texture.levelHeight[level]);
+        // nearest is bilinear with the weights forced to 0 and no half texel shift
+        float shift = linear ? 0.5f : 0.0f;
+        float xs = u * width - shift, ys = v * height - shift;
+        float x0 = std::floor(xs), y0 = std::floor(ys);
+        float fx = linear ? xs - x0 : 0.0f, fy = linear ? ys - y0 : 0.0f;
+        int ix0 = static_cast<int>(wrap(x0, width, state.wrapS));
+        int ix1 = static_cast<int>(wrap(x0 + 1.0f, width, state.wrapS));
+        int iy0 = static_cast<int>(wrap(y0, height, state.wrapT));
+        int iy1 = static_cast<int>(wrap(y0 + 1.0f, height, state.wrapT));
+
+        uint32_t t00 = texture.texel(level, ix0, iy0), t10 = texture.texel(level, ix1, iy0);
+        uint32_t t01 = texture.texel(level, ix0, iy1), t11 = texture.texel(level, ix1, iy1);
+        for (int c = 0; c < 4; c++)
+        {
+            int shiftBits = c * 8;
+            float c00 = static_cast<float>((t00 >> shiftBits) & 0xFF), c10 = static_cast<float>((t10 >> shiftBits) & 0xFF);
+            float c01 = static_cast<float>((t01 >> shiftBits) & 0xFF), c11 = static_cast<float>((t11 >> shiftBits) & 0xFF);
+            float top = c00 + (c10 - c00) * fx;
+            float bottom = c01 + (c11 - c01) * fx;
+            out[c] = (top + (bottom - top) * fy) * (1.0f / 255.0f);
+        }
+    }
+
+#if defined(TEXTURE_SAMPLER_AVX2) || defined(TEXTURE_SAMPLER_SSE41)
+    static texture_sampler_detail::Vf wrap8(texture_sampler_detail::Vf coord, texture_sampler_detail::Vf size, SamplerWrap mode)
+    {
+        using namespace texture_sampler_detail;
+        if (mode == SamplerWrap::Repeat)
+        {
+            coord = coord - size * vfloor(coord / size);
+        }
+        else if (mode == SamplerWrap::MirroredRepeat)
+        {
+            Vf period = size + size;
+            coord = coord - period * vfloor(coord / period);
+            coord = select(cmpge(coord, size), period - set1(1.0f) - coord, coord);
+        }
+        return vmin(vmax(coord, set1(0.0f)), size - set1(1.0f));
+    }
+
+    void bilinear8(texture_sampler_detail::Vi level, texture_sampler_detail::Vf u, texture_sampler_detail::Vf v,
+        texture_sampler_detail::Vf linear, texture_sampler_detail::Vf out[4]) const
+    {
+        using namespace texture_sampler_detail;
+        Vi offset = gather(texture.levelOffset, level);
+        Vi tilesX = gather(texture.levelTilesX, level);
+        Vf width = toFloat(gather(texture.levelWidth, level));
+        Vf height = toFloat(gather(texture.levelHeight, level));
+        const int32_t* texels = reinterpret_cast<const int32_t*>(texture.texels.data());
+
+        Vf shift = linear * set1(0.5f);
+        Vf xs = u * width - shift, ys = v * height - shift;
+        Vf x0 = vfloor(xs), y0 = vfloor(ys);
+        Vf fx = (xs - x0) * linear, fy = (ys - y0) * linear;
+        Vf one = set1(1.0f);
+        Vi ix0 = toInt(wrap8(x0, width, state.wrapS));
+        Vi iy0 = toInt(wrap8(y0, height, state.wrapT));
+
+        // tiled address: offset + ((y >> 2) * tilesX + (x >> 2)) * 16 + (y & 3) * 4 + (x & 3)
+        Vi three = set1i(3);
+        auto fetch = [&](Vi x, Vi y) {
+            Vi tile = shl(shr(y, 2) * tilesX + shr(x, 2), 4);
+            Vi inTile = shl(y & three, 2) + (x & three);
+            return gather(texels, offset + tile + inTile);
+        };
+        Vi mask = set1i(0xFF);
+        Vf scale = set1(1.0f / 255.0f);
+
+        Vi t00 = fetch(ix0, iy0);
+        // nearest everywhere (the common GL_NEAREST case) only needs the one tap
+        if (movemask(cmpgt(linear, set1(0.0f))) == 0)
+        {
+            for (int c = 0; c < 4; c++)
+                out[c] = toFloat(shr(t00, c * 8) & mask) * scale;
+            return;
+        }
+
+        Vi ix1 = toInt(wrap8(x0 + one, width, state.wrapS));
+        Vi iy1 = toInt(wrap8(y0 + one, height, state.wrapT));
+        Vi t10 = fetch(ix1, iy0), t01 = fetch(ix0, iy1), t11 = fetch(ix1, iy1);
+        for (int c = 0; c < 4; c++)
+        {
+            Vf c00 = toFloat(shr(t00, c * 8) & mask), c10 = toFloat(shr(t10, c * 8) & mask);
+            Vf c01 = toFloat(shr(t01, c * 8) & mask), c11 = toFloat(shr(t11, c * 8) & mask);
+            Vf top = c00 + (c10 - c00) * fx;
+            Vf bottom = c01 + (c11 - c01) * fx;
+            out[c] = (top + (bottom - top) * fy) * scale;
+        }
+    }
+#endif
+};
+
+#endif
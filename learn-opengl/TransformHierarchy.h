@@ -0,0 +1,270 @@
+#ifndef TRANSFORM_HIERARCHY_H
+#define TRANSFORM_HIERARCHY_H
+
+#include "JobSystem.h"
+#include "Transforms.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include <glm/glm/glm.hpp>
+#include <glm/glm/gtc/type_ptr.hpp>
+
+// Parent/child transforms where a world matrix is only recomputed when its local transform or
+// one of its parents' changed. The nodes are kept sorted by depth (roots first, then their
+// children, ...), so every parent comes before its children and one forward pass over the
+// arrays sees a parent's new world matrix before any child needs it. A changed node marks its
+// children on the way, so whole subtrees are updated without recursion and untouched ones cost
+// a flag test each.
+//
+// Nodes at the same depth don't depend on each other, big levels are split over the job
+// system. Runs of changed nodes have their local matrices composed several at a time with SIMD
+// (TransformComposer's code), and parent * local is a SIMD multiply.
+//
+// Nodes are named by the handle add returns, their position in the arrays (index) changes
+// when the structure does. worldMatrices() is in index order for uploading all of them.
+class TransformHierarchy
+{
+public:
+    static const uint32_t none = 0xffffffffu;
+
+    // ------------------------------------------------------------------------
+    explicit TransformHierarchy(JobSystem& jobs = JobSystem::shared(), size_t blockSize = 4096)
+        : jobs(jobs), blockSize(blockSize)
+    {
+    }
+
+    // adds a node under parent (none for a root) at a position relative to it
+    // ------------------------------------------------------------------------
+    uint32_t add(uint32_t parent = none, float x = 0.0f, float y = 0.0f, float z = 0.0f)
+    {
+        uint32_t handle = static_cast<uint32_t>(parentOf.size());
+        if (parent != none && parent >= handle)
+        {
+            std::cout << "ERROR::TRANSFORM_HIERARCHY::UNKNOWN_PARENT: " << parent << std::endl;
+            parent = none;
+        }
+        parentOf.push_back(parent);
+        indexOf.push_back(static_cast<uint32_t>(handleOf.size()));
+        handleOf.push_back(handle);
+        local.add(x, y, z);
+        parentIndex.push_back(parent == none ? -1 : static_cast<int32_t>(indexOf[parent]));
+        dirty.push_back(1);
+        changed.push_back(0);
+        localMatrices.push_back(glm::mat4(1.0f));
+        world.push_back(glm::mat4(1.0f));
+        // a new child can come after nodes deeper than it
+        structureChanged = true;
+        return handle;
+    }
+
+    // moves a node and its subtree under another parent, false when that would make a loop
+    // ------------------------------------------------------------------------
+    bool setParent(uint32_t handle, uint32_t parent)
+    {
+        for (uint32_t above = parent; above != none; above = parentOf[above])
+        {
+            if (above == handle)
+            {
+                std::cout << "ERROR::TRANSFORM_HIERARCHY::PARENT_LOOP: " << handle << " under " << parent << std::endl;
+                return false;
+            }
+        }
+        parentOf[handle] = parent;
+        dirty[indexOf[handle]] = 1;
+        structureChanged = true;
+        return true;
+    }
+
+    // the setters only mark the node changed when the value is different
+    // ------------------------------------------------------------------------
+    void setPosition(uint32_t handle, float x, float y, float z)
+    {
+        uint32_t i = indexOf[handle];
+        if (local.positionX[i] == x && local.positionY[i] == y && local.positionZ[i] == z)
+            return;
+        local.setPosition(i, x, y, z);
+        dirty[i] = 1;
+    }
+
+    void setRotation(uint32_t handle, float x, float y, float z, float w)
+    {
+        uint32_t i = indexOf[handle];
+        if (local.rotationX[i] == x && local.rotationY[i] == y && local.rotationZ[i] == z && local.rotationW[i] == w)
+            return;
+        local.setRotation(i, x, y, z, w);
+        dirty[i] = 1;
+    }
+
+    void setAxisAngle(uint32_t handle, float angle, float axisX, float axisY, float axisZ)
+    {
+        float q[4];
+        transforms_detail::axisAngle(angle, axisX, axisY, axisZ, q);
+        setRotation(handle, q[0], q[1], q[2], q[3]);
+    }
+
+    void setScale(uint32_t handle, float x, float y, float z)
+    {
+        uint32_t i = indexOf[handle];
+        if (local.scaleX[i] == x && local.scaleY[i] == y && local.scaleZ[i] == z)
+            return;
+        local.setScale(i, x, y, z);
+        dirty[i] = 1;
+    }
+
+    // Recomputes the world matrices of the changed nodes and everything under them. With out
+    // (TransformBuffer::data()) every world matrix is also written there in index order, each
+    // block by the job that updated it, since a ring segment needs all of them every frame
+    // ------------------------------------------------------------------------
+    void update(float* out = nullptr)
+    {
+        if (structureChanged)
+            sortByDepth();
+        for (size_t level = 0; level + 1 < levelStart.size(); level++)
+        {
+            size_t begin = levelStart[level], end = levelStart[level + 1];
+            if (end - begin <= blockSize || jobs.threadCount() == 0)
+            {
+                updateRange(begin, end, out);
+                continue;
+            }
+            jobs.parallelFor(end - begin, blockSize, [&](size_t first, size_t last)
+            {
+                updateRange(begin + first, begin + last, out);
+            });
+        }
+    }
+
+    const glm::mat4& worldMatrix(uint32_t handle) const { return world[indexOf[handle]]; }
+
+    // every world matrix, in index order
+    const glm::mat4* worldMatrices() const { return world.data(); }
+    uint32_t index(uint32_t handle) const { return indexOf[handle]; }
+    uint32_t parent(uint32_t handle) const { return parentOf[handle]; }
+    size_t size() const { return handleOf.size(); }
+
+private:
+    JobSystem& jobs;
+    size_t blockSize;
+    bool structureChanged = false;
+
+    // by handle
+    std::vector<uint32_t> parentOf;
+    std::vector<uint32_t> indexOf;
+
+    // by index, sorted by depth
+    std::vector<uint32_t> handleOf;
+    TransformArrays local;
+    std::vector<int32_t> parentIndex;
+    std::vector<uint8_t> dirty;
+    std::vector<uint8_t> changed;
+    std::vector<glm::mat4> localMatrices;
+    std::vector<glm::mat4> world;
+    // indices where each depth starts, and the end
+    std::vector<size_t> levelStart;
+
+    void updateRange(size_t begin, size_t end, float* out)
+    {
+        // parents are in an earlier level, so their changed flags are final
+        for (size_t i = begin; i < end; i++)
+        {
+            int32_t p = parentIndex[i];
+            changed[i] = dirty[i] | (p >= 0 ? changed[p] : 0);
+            dirty[i] = 0;
+        }
+        size_t i = begin;
+        while (i < end)
+        {
+            if (!changed[i])
+            {
+                i++;
+                continue;
+            }
+            size_t run = i;
+            while (run < end && changed[run])
+                run++;
+            transforms_detail::composeRange(local, i, run, glm::value_ptr(localMatrices[i]));
+            for (; i < run; i++)
+            {
+                int32_t p = parentIndex[i];
+                if (p >= 0)
+                    transforms_detail::multiply(glm::value_ptr(world[p]), glm::value_ptr(localMatrices[i]), glm::value_ptr(world[i]));
+                else
+                    world[i] = localMatrices[i];
+            }
+        }
+        // one run of whole matrices, the best way to fill write combined memory
+        if (out && end > begin)
+            std::memcpy(out + begin * 16, glm::value_ptr(world[begin]), (end - begin) * sizeof(glm::mat4));
+    }
+
+    // counting sort by depth, nodes of the same depth keep their order
+    void sortByDepth()
+    {
+        size_t count = handleOf.size();
+        std::vector<uint32_t> depth(count, uint32_t(none));
+        uint32_t maxDepth = 0;
+        for (uint32_t handle = 0; handle < count; handle++)
+        {
+            // walks up to the first node whose depth is known, then fills in the way back down
+            uint32_t known = handle, steps = 0;
+            while (known != none && depth[known] == none)
+            {
+                known = parentOf[known];
+                steps++;
+            }
+            uint32_t d = (known == none ? 0 : depth[known] + 1) + steps - 1;
+            for (uint32_t node = handle; node != known; node = parentOf[node])
+                depth[node] = d--;
+            maxDepth = std::max(maxDepth, depth[handle]);
+        }
+
+        levelStart.assign(maxDepth + 2, 0);
+        for (uint32_t handle = 0; handle < count; handle++)
+            levelStart[depth[handle] + 1]++;
+        for (size_t level = 1; level < levelStart.size(); level++)
+            levelStart[level] += levelStart[level - 1];
+
+        std::vector<size_t> next(levelStart.begin(), levelStart.end() - 1);
+        std::vector<uint32_t> order(count);
+        for (uint32_t index = 0; index < count; index++)
+        {
+            uint32_t handle = handleOf[index];
+            order[next[depth[handle]]++] = index;
+        }
+
+        TransformArrays sortedLocal;
+        std::vector<uint32_t> sortedHandles(count);
+        std::vector<uint8_t> sortedDirty(count), sortedChanged(count);
+        std::vector<glm::mat4> sortedWorld(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t from = order[i];
+            sortedHandles[i] = handleOf[from];
+            sortedLocal.add(local.positionX[from], local.positionY[from], local.positionZ[from]);
+            sortedLocal.setRotation(i, local.rotationX[from], local.rotationY[from], local.rotationZ[from], local.rotationW[from]);
+            sortedLocal.setScale(i, local.scaleX[from], local.scaleY[from], local.scaleZ[from]);
+            sortedDirty[i] = dirty[from];
+            sortedChanged[i] = changed[from];
+            sortedWorld[i] = world[from];
+            indexOf[handleOf[from]] = static_cast<uint32_t>(i);
+        }
+        handleOf.swap(sortedHandles);
+        local = std::move(sortedLocal);
+        dirty.swap(sortedDirty);
+        changed.swap(sortedChanged);
+        world.swap(sortedWorld);
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t parent = parentOf[handleOf[i]];
+            parentIndex[i] = parent == none ? -1 : static_cast<int32_t>(indexOf[parent]);
+        }
+        structureChanged = false;
+    }
+};
+
+#endif
@@ -0,0 +1,328 @@
+#ifndef TRANSFORMS_H
+#define TRANSFORMS_H
+
+#include <glad/glad.h>
+
+#include "JobSystem.h"
+#include "MappedRing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+// Same choice of instruction set as FrustumCulling.h: AVX (and AVX-512 builds) compose 8
+// matrices at a time, SSE2 4
+#if defined(__AVX__)
+#define TRANSFORMS_AVX 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || (defined(_MSC_VER) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)))
+#define TRANSFORMS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace transforms_detail
+{
+    // unit quaternion (x, y, z, w) of a rotation by angle radians around an axis
+    inline void axisAngle(float angle, float axisX, float axisY, float axisZ, float* q)
+    {
+        float length = std::sqrt(axisX * axisX + axisY * axisY + axisZ * axisZ);
+        float s = length > 0.0f ? std::sin(0.5f * angle) / length : 0.0f;
+        q[0] = axisX * s;
+        q[1] = axisY * s;
+        q[2] = axisZ * s;
+        q[3] = std::cos(0.5f * angle);
+    }
+}
+
+// Position, rotation and scale of many objects as structure of arrays, so a whole run of
+// objects can be loaded into SIMD lanes at once. Rotations are unit quaternions (x, y, z, w).
+// The matrix of an object is translate * rotate * scale, the same as chaining glm::translate,
+// glm::rotate and glm::scale in that order.
+struct TransformArrays
+{
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+    std::vector<float> scaleX, scaleY, scaleZ;
+
+    // adds an object at a position with no rotation and a scale of 1, returns its index
+    // ------------------------------------------------------------------------
+    size_t add(float x, float y, float z)
+    {
+        positionX.push_back(x);
+        positionY.push_back(y);
+        positionZ.push_back(z);
+        rotationX.push_back(0.0f);
+        rotationY.push_back(0.0f);
+        rotationZ.push_back(0.0f);
+        rotationW.push_back(1.0f);
+        scaleX.push_back(1.0f);
+        scaleY.push_back(1.0f);
+        scaleZ.push_back(1.0f);
+        return positionX.size() - 1;
+    }
+
+    void setPosition(size_t i, float x, float y, float z)
+    {
+        positionX[i] = x;
+        positionY[i] = y;
+        positionZ[i] = z;
+    }
+
+    // takes a unit quaternion
+    void setRotation(size_t i, float x, float y, float z, float w)
+    {
+        rotationX[i] = x;
+        rotationY[i] = y;
+        rotationZ[i] = z;
+        rotationW[i] = w;
+    }
+
+    // angle in radians around an axis, like glm::rotate
+    // ------------------------------------------------------------------------
+    void setAxisAngle(size_t i, float angle, float axisX, float axisY, float axisZ)
+    {
+        float q[4];
+        transforms_detail::axisAngle(angle, axisX, axisY, axisZ, q);
+        setRotation(i, q[0], q[1], q[2], q[3]);
+    }
+
+    void setScale(size_t i, float x, float y, float z)
+    {
+        scaleX[i] = x;
+        scaleY[i] = y;
+        scaleZ[i] = z;
+    }
+
+    void clear()
+    {
+        for (std::vector<float>* array : { &positionX, &positionY, &positionZ, &rotationX, &rotationY, &rotationZ, &rotationW, &scaleX, &scaleY, &scaleZ })
+            array->clear();
+    }
+
+    size_t size() const { return positionX.size(); }
+};
+
+namespace transforms_detail
+{
+    // matrix of object i as 16 column major floats
+    inline void compose(const TransformArrays& t, size_t i, float* out)
+    {
+        float x = t.rotationX[i], y = t.rotationY[i], z = t.rotationZ[i], w = t.rotationW[i];
+        float xx = 2.0f * x * x, yy = 2.0f * y * y, zz = 2.0f * z * z;
+        float xy = 2.0f * x * y, xz = 2.0f * x * z, yz = 2.0f * y * z;
+        float wx = 2.0f * w * x, wy = 2.0f * w * y, wz = 2.0f * w * z;
+        float sx = t.scaleX[i], sy = t.scaleY[i], sz = t.scaleZ[i];
+        out[0] = (1.0f - yy - zz) * sx;
+        out[1] = (xy + wz) * sx;
+        out[2] = (xz - wy) * sx;
+        out[3] = 0.0f;
+        out[4] = (xy - wz) * sy;
+        out[5] = (1.0f - xx - zz) * sy;
+        out[6] = (yz + wx) * sy;
+        out[7] = 0.0f;
+        out[8] = (xz + wy) * sz;
+        out[9] = (yz - wx) * sz;
+        out[10] = (1.0f - xx - yy) * sz;
+        out[11] = 0.0f;
+        out[12] = t.positionX[i];
+        out[13] = t.positionY[i];
+        out[14] = t.positionZ[i];
+        out[15] = 1.0f;
+    }
+
+#if defined(TRANSFORMS_AVX) || defined(TRANSFORMS_SSE2)
+    // one element of the matrices of width objects per register, transposed into whole
+    // columns when stored
+#if defined(TRANSFORMS_AVX)
+    const int width = 8;
+    typedef __m256 Vf;
+    inline Vf load(const float* p) { return _mm256_loadu_ps(p); }
+    inline Vf set1(float f) { return _mm256_set1_ps(f); }
+    inline Vf mul(Vf a, Vf b) { return _mm256_mul_ps(a, b); }
+    inline Vf add(Vf a, Vf b) { return _mm256_add_ps(a, b); }
+    inline Vf sub(Vf a, Vf b) { return _mm256_sub_ps(a, b); }
+
+    // rows r0..r3 of one column of 8 matrices, written to that column of each. The shuffles
+    // stay inside 128 bit halves, the low half ends up with objects 0-3 and the high one 4-7
+    inline void storeColumn(float* out, Vf r0, Vf r1, Vf r2, Vf r3)
+    {
+        Vf t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+        Vf t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+        Vf c0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)), c1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        Vf c2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)), c3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+        _mm_storeu_ps(out, _mm256_castps256_ps128(c0));
+        _mm_storeu_ps(out + 16, _mm256_castps256_ps128(c1));
+        _mm_storeu_ps(out + 32, _mm256_castps256_ps128(c2));
+        _mm_storeu_ps(out + 48, _mm256_castps256_ps128(c3));
+        _mm_storeu_ps(out + 64, _mm256_extractf128_ps(c0, 1));
+        _mm_storeu_ps(out + 80, _mm256_extractf128_ps(c1, 1));
+        _mm_storeu_ps(out + 96, _mm256_extractf128_ps(c2, 1));
+        _mm_storeu_ps(out + 112, _mm256_extractf128_ps(c3, 1));
+    }
+#else
+    const int width = 4;
+    typedef __m128 Vf;
+    inline Vf load(const float* p) { return _mm_loadu_ps(p); }
+    inline Vf set1(float f) { return _mm_set1_ps(f); }
+    inline Vf mul(Vf a, Vf b) { return _mm_mul_ps(a, b); }
+    inline Vf add(Vf a, Vf b) { return _mm_add_ps(a, b); }
+    inline Vf sub(Vf a, Vf b) { return _mm_sub_ps(a, b); }
+
+    inline void storeColumn(float* out, Vf r0, Vf r1, Vf r2, Vf r3)
+    {
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _mm_storeu_ps(out, r0);
+        _mm_storeu_ps(out + 16, r1);
+        _mm_storeu_ps(out + 32, r2);
+        _mm_storeu_ps(out + 48, r3);
+    }
+#endif
+
+    // matrices of objects [i, i + width)
+    inline void composeWide(const TransformArrays& t, size_t i, float* out)
+    {
+        Vf x = load(&t.rotationX[i]), y = load(&t.rotationY[i]), z = load(&t.rotationZ[i]), w = load(&t.rotationW[i]);
+        Vf x2 = add(x, x), y2 = add(y, y), z2 = add(z, z);
+        Vf xx = mul(x, x2), yy = mul(y, y2), zz = mul(z, z2);
+        Vf xy = mul(x, y2), xz = mul(x, z2), yz = mul(y, z2);
+        Vf wx = mul(w, x2), wy = mul(w, y2), wz = mul(w, z2);
+        Vf sx = load(&t.scaleX[i]), sy = load(&t.scaleY[i]), sz = load(&t.scaleZ[i]);
+        Vf one = set1(1.0f), zero = set1(0.0f);
+        // every object's 16 floats are written within this call, whole cache lines at a time
+        // for write combined mapped memory
+        storeColumn(out, mul(sub(one, add(yy, zz)), sx), mul(add(xy, wz), sx), mul(sub(xz, wy), sx), zero);
+        storeColumn(out + 4, mul(sub(xy, wz), sy), mul(sub(one, add(xx, zz)), sy), mul(add(yz, wx), sy), zero);
+        storeColumn(out + 8, mul(add(xz, wy), sz), mul(sub(yz, wx), sz), mul(sub(one, add(xx, yy)), sz), zero);
+        storeColumn(out + 12, load(&t.positionX[i]), load(&t.positionY[i]), load(&t.positionZ[i]), one);
+    }
+#endif
+
+    // matrices of objects [begin, end), out is the matrix of object begin
+    // ------------------------------------------------------------------------
+    inline void composeRange(const TransformArrays& t, size_t begin, size_t end, float* out)
+    {
+        size_t i = begin;
+#if defined(TRANSFORMS_AVX) || defined(TRANSFORMS_SSE2)
+        for (; i + width <= end; i += width)
+            composeWide(t, i, out + (i - begin) * 16);
+#endif
+        for (; i < end; i++)
+            compose(t, i, out + (i - begin) * 16);
+    }
+
+    // out = a * b for column major matrices like glm::mat4, out can't be a or b. A column of the
+    // result is the columns of a weighted by a column of b, a register each
+    // ------------------------------------------------------------------------
+    inline void multiply(const float* a, const float* b, float* out)
+    {
+#if defined(TRANSFORMS_AVX) || defined(TRANSFORMS_SSE2)
+        __m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + 4), a2 = _mm_loadu_ps(a + 8), a3 = _mm_loadu_ps(a + 12);
+        for (int column = 0; column < 4; column++)
+        {
+            const float* c = b + column * 4;
+            __m128 low = _mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(c[0])), _mm_mul_ps(a1, _mm_set1_ps(c[1])));
+            __m128 high = _mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(c[2])), _mm_mul_ps(a3, _mm_set1_ps(c[3])));
+            _mm_storeu_ps(out + column * 4, _mm_add_ps(low, high));
+        }
+#else
+        for (int column = 0; column < 4; column++)
+            for (int row = 0; row < 4; row++)
+                out[column * 4 + row] = a[row] * b[column * 4] + a[4 + row] * b[column * 4 + 1]
+                    + a[8 + row] * b[column * 4 + 2] + a[12 + row] * b[column * 4 + 3];
+#endif
+    }
+}
+
+// Writes the world matrices of every object in a TransformArrays, column major like
+// glm::mat4, 16 floats an object. Blocks of objects are composed in parallel on the job
+// system and every block a SIMD register's width at a time. The output can be mapped buffer
+// memory (TransformBuffer), it is only ever written.
+class TransformComposer
+{
+public:
+    // ------------------------------------------------------------------------
+    explicit TransformComposer(JobSystem& jobs = JobSystem::shared(), size_t blockSize = 4096)
+        : jobs(jobs), blockSize(blockSize)
+    {
+    }
+
+    void compose(const TransformArrays& transforms, float* out)
+    {
+        compose(transforms, 0, transforms.size(), out);
+    }
+
+    // objects [first, first + count), out is where the matrix of first goes
+    // ------------------------------------------------------------------------
+    void compose(const TransformArrays& transforms, size_t first, size_t count, float* out)
+    {
+        if (count <= blockSize || jobs.threadCount() == 0)
+        {
+            transforms_detail::composeRange(transforms, first, first + count, out);
+            return;
+        }
+        jobs.parallelFor(count, blockSize, [&](size_t begin, size_t end)
+        {
+            transforms_detail::composeRange(transforms, first + begin, first + end, out + begin * 16);
+        });
+    }
+
+private:
+    JobSystem& jobs;
+    size_t blockSize;
+};
+
+// Ring of matrices in a MappedRing bound as a shader storage buffer, each frame's segment has
+// room for capacity matrices. They are written straight into the segment through data(),
+// column major like glm::mat4, 16 floats a matrix.
+class TransformBuffer
+{
+public:
+    unsigned int ID;
+
+    // ------------------------------------------------------------------------
+    explicit TransformBuffer(size_t capacity, int framesInFlight = 3)
+        : capacity(capacity),
+        ring(capacity * 16 * sizeof(float), framesInFlight, MappedRing::offsetAlignment(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT))
+    {
+        ID = ring.ID;
+    }
+
+    TransformBuffer(const TransformBuffer&) = delete;
+    TransformBuffer& operator=(const TransformBuffer&) = delete;
+
+    // moves to the next segment, waiting if the GPU is still using it, and returns where its
+    // matrices go
+    // ------------------------------------------------------------------------
+    float* beginFrame()
+    {
+        ring.beginFrame();
+        return data();
+    }
+
+    float* data() const { return reinterpret_cast<float*>(ring.data()); }
+
+    // binds the first count matrices of this frame to a shader storage binding
+    // ------------------------------------------------------------------------
+    void bind(unsigned int binding, size_t count) const
+    {
+        if (count > capacity)
+        {
+            std::cout << "ERROR::TRANSFORM_BUFFER::TOO_MANY_OBJECTS: " << count << ", room for " << capacity << std::endl;
+            count = capacity;
+        }
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, ID, ring.offset(), std::max<size_t>(count, 1) * 16 * sizeof(float));
+    }
+
+    // call after the last draw that reads this frame's matrices
+    void endFrame() { ring.endFrame(); }
+
+    size_t size() const { return capacity; }
+
+private:
+    size_t capacity;
+    MappedRing ring;
+};
+
+#endif
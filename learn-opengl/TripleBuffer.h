@@ -0,0 +1,54 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Lock free single producer/single consumer triple buffer. The writer always has a slot of its
+// own to fill, the reader always has a slot of its own to read and the third slot is swapped
+// between them, so neither side ever waits and the reader always sees the newest complete value.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() = default;
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // producer: the slot to fill in before calling publish
+    // ------------------------------------------------------------------------
+    T& back() { return slots[backIndex]; }
+
+    // producer: hands the back slot to the reader
+    // ------------------------------------------------------------------------
+    void publish()
+    {
+        uint8_t previous = middle.exchange(static_cast<uint8_t>(backIndex | freshBit), std::memory_order_acq_rel);
+        backIndex = previous & indexMask;
+    }
+
+    // consumer: picks up the newest published value (if there is one) and returns it.
+    // The reference stays valid until the next call
+    // ------------------------------------------------------------------------
+    const T& read()
+    {
+        if (middle.load(std::memory_order_relaxed) & freshBit)
+        {
+            uint8_t previous = middle.exchange(frontIndex, std::memory_order_acq_rel);
+            frontIndex = previous & indexMask;
+        }
+        return slots[frontIndex];
+    }
+
+private:
+    static const uint8_t freshBit = 4;
+    static const uint8_t indexMask = 3;
+
+    T slots[3] = {};
+    // each index is only touched by its own side, the middle one is shared
+    uint8_t backIndex = 0;
+    std::atomic<uint8_t> middle{ 1 };
+    uint8_t frontIndex = 2;
+};
+
+#endif
@@ -0,0 +1,22 @@
+// std140 blocks shared by the shaders, the C++ side of these is in UniformBlocks.h
+#ifndef UNIFORM_BLOCKS_GLSL
+#define UNIFORM_BLOCKS_GLSL
+
+// set once per frame
+layout (std140, binding = 0) uniform FrameData
+{
+    vec2 offset;
+    float blendScale;
+};
+
+// set once per object
+layout (std140, binding = 1) uniform ObjectData
+{
+    mat4 transform;
+    // where the object's two textures are in the texture array (see TextureArray.h):
+    // texture coords are scaled by zw and offset by xy, then looked up in the layer
+    vec4 textureRegions[2];
+    ivec4 textureLayers;
+};
+
+#endif
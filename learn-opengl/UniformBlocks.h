@@ -0,0 +1,34 @@
+#ifndef UNIFORM_BLOCKS_H
+#define UNIFORM_BLOCKS_H
+
+#include <cstddef>
+
+#include <glm/glm/glm.hpp>
+
+#include "Shaders.h"
+
+// C++ side of the uniform blocks declared in UniformBlocks.glsl. These have to follow the std140
+// rules: vec2 aligned to 8 bytes, vec3/vec4/mat4 columns to 16, block size a multiple of 16.
+// Shader::verifyUniformBlock checks them against what the driver reports.
+
+// binding = 0, set once per frame
+struct FrameData
+{
+    float offset[2];
+    float blendScale;
+    float padding;
+};
+
+// binding = 1, set once per object
+struct ObjectData
+{
+    glm::mat4 transform;
+    // offset xy and scale zw of the object's two textures in the texture array, and their layers
+    float textureRegions[2][4];
+    int textureLayers[4];
+};
+
+static const UniformField frameDataFields[] = { UNIFORM_FIELD(FrameData, offset), UNIFORM_FIELD(FrameData, blendScale) };
+static const UniformField objectDataFields[] = { UNIFORM_FIELD(ObjectData, transform), UNIFORM_FIELD(ObjectData, textureRegions), UNIFORM_FIELD(ObjectData, textureLayers) };
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include "MappedRing.h"
+
+#include <cstring>
+#include <iostream>
+
+// Ring of std140 uniform blocks in a MappedRing. Each frame's segment has room for
+// slotsPerFrame blocks, writing one is a plain memcpy and a draw only needs a
+// glBindBufferRange, instead of one glUniform* call per uniform.
+template <typename T>
+class UniformBuffer
+{
+public:
+    unsigned int ID;
+
+    // ------------------------------------------------------------------------
+    UniformBuffer(unsigned int binding, int slotsPerFrame = 1, int framesInFlight = 3)
+        : binding(binding), slotsPerFrame(slotsPerFrame),
+        slotSize(slotBytes(MappedRing::offsetAlignment(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT))),
+        ring(slotSize * slotsPerFrame, framesInFlight)
+    {
+        ID = ring.ID;
+    }
+
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    // moves to the next segment, waiting if the GPU is still using it
+    // ------------------------------------------------------------------------
+    void beginFrame()
+    {
+        ring.beginFrame();
+        used = 0;
+    }
+
+    // copies the block into this frame's segment and returns its slot
+    // ------------------------------------------------------------------------
+    int push(const T& data)
+    {
+        if (used == slotsPerFrame)
+        {
+            std::cout << "ERROR::UNIFORM_BUFFER::OUT_OF_SLOTS: " << slotsPerFrame << " per frame" << std::endl;
+            return used - 1;
+        }
+        std::memcpy(ring.data() + used * slotSize, &data, sizeof(T));
+        return used++;
+    }
+
+    // binds a slot of this frame to the block binding point
+    // ------------------------------------------------------------------------
+    void bind(int slot) const
+    {
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, ID, ring.offset() + slot * slotSize, sizeof(T));
+    }
+
+    // call after the last draw that uses this frame's blocks
+    void endFrame() { ring.endFrame(); }
+
+private:
+    unsigned int binding;
+    int slotsPerFrame;
+    // every bound range has to start at a multiple of the offset alignment
+    GLsizeiptr slotSize;
+    MappedRing ring;
+    int used = 0;
+
+    static GLsizeiptr slotBytes(GLsizeiptr alignment)
+    {
+        return (sizeof(T) + alignment - 1) / alignment * alignment;
+    }
+};
+
+#endif
@@ -0,0 +1,284 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// F16C does the float -> half conversion in hardware. MSVC has no flag for it on its own but
+// every AVX2 CPU has it, so /arch:AVX2 turns it on. SSE2 is always there on x64.
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define VERTEX_FORMAT_F16C 1
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || (defined(_MSC_VER) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)))
+#define VERTEX_FORMAT_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Converters from float to the compact types vertex attributes can be stored as. Each one
+// has a scalar version for the leftovers and a SIMD loop for the bulk, both round the same way
+// (to nearest even) so the output doesn't depend on which path ran.
+namespace vertex_packing
+{
+    inline uint32_t floatBits(float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    inline float bitsFloat(uint32_t bits)
+    {
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // IEEE half float: 1 sign, 5 exponent, 10 mantissa bits. Largest value is 65504
+    // ------------------------------------------------------------------------
+    inline uint16_t toHalf(float value)
+    {
+        uint32_t bits = floatBits(value);
+        uint32_t sign = (bits >> 16) & 0x8000u;
+        bits &= 0x7FFFFFFFu;
+        uint32_t half;
+        if (bits >= (127u + 16u) << 23)
+            // too big, infinity or NaN
+            half = bits > 0x7F800000u ? 0x7E00u : 0x7C00u;
+        else if (bits < (127u - 14u) << 23)
+        {
+            // too small for a normal half. Adding 0.5 lines the half's subnormal mantissa up
+            // with the bottom bits of the float and lets the FPU do the rounding
+            const uint32_t magic = (127u - 15u + 23u - 10u + 1u) << 23;
+            half = floatBits(bitsFloat(bits) + bitsFloat(magic)) - magic;
+        }
+        else
+        {
+            uint32_t odd = (bits >> 13) & 1u;
+            // rebias the exponent and round, a carry out of the mantissa bumps the exponent
+            bits += ((15u - 127u) << 23) + 0xFFFu + odd;
+            half = bits >> 13;
+        }
+        return static_cast<uint16_t>(half | sign);
+    }
+
+    inline uint8_t toUnorm8(float value)
+    {
+        return static_cast<uint8_t>(std::lrint(std::min(std::max(value, 0.0f), 1.0f) * 255.0f));
+    }
+
+    // 10 bits for x, y and z and 2 for w, the layout of GL_INT_2_10_10_10_REV
+    // ------------------------------------------------------------------------
+    inline uint32_t toSnorm1010102(float x, float y, float z, float w)
+    {
+        auto snorm = [](float value, float scale, uint32_t mask)
+        {
+            return static_cast<uint32_t>(std::lrint(std::min(std::max(value, -1.0f), 1.0f) * scale)) & mask;
+        };
+        return snorm(x, 511.0f, 0x3FFu) | snorm(y, 511.0f, 0x3FFu) << 10 | snorm(z, 511.0f, 0x3FFu) << 20 | snorm(w, 1.0f, 0x3u) << 30;
+    }
+
+    // ------------------------------------------------------------------------
+    inline void packHalf(const float* in, uint16_t* out, size_t count)
+    {
+        size_t i = 0;
+#if defined(VERTEX_FORMAT_F16C)
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i halves = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), halves);
+        }
+#endif
+        for (; i < count; i++)
+            out[i] = toHalf(in[i]);
+    }
+
+    // ------------------------------------------------------------------------
+    inline void packUnorm8(const float* in, uint8_t* out, size_t count)
+    {
+        size_t i = 0;
+#if defined(VERTEX_FORMAT_SSE2)
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 scale = _mm_set1_ps(255.0f);
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i ints[4];
+            for (int j = 0; j < 4; j++)
+            {
+                __m128 value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i + j * 4), zero), one);
+                ints[j] = _mm_cvtps_epi32(_mm_mul_ps(value, scale));
+            }
+            // 32 -> 16 -> 8 bits, the values are already in range so saturation never kicks in
+            __m128i shorts0 = _mm_packs_epi32(ints[0], ints[1]);
+            __m128i shorts1 = _mm_packs_epi32(ints[2], ints[3]);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(shorts0, shorts1));
+        }
+#endif
+        for (; i < count; i++)
+            out[i] = toUnorm8(in[i]);
+    }
+
+    // in has components (3 or 4) floats per value, w is 0 when there are only 3
+    // ------------------------------------------------------------------------
+    inline void packSnorm1010102(const float* in, int components, uint32_t* out, size_t count)
+    {
+        size_t i = 0;
+#if defined(VERTEX_FORMAT_SSE2)
+        const __m128 low = _mm_set1_ps(-1.0f);
+        const __m128 high = _mm_set1_ps(1.0f);
+        const __m128 scale = _mm_set1_ps(511.0f);
+        const __m128i mask = _mm_set1_epi32(0x3FF);
+        for (; i + 4 <= count; i += 4)
+        {
+            // four values at a time, transposed so every register holds one component
+            float xyzw[16] = {};
+            for (int v = 0; v < 4; v++)
+                for (int c = 0; c < components; c++)
+                    xyzw[v * 4 + c] = in[(i + v) * components + c];
+            __m128 x = _mm_loadu_ps(xyzw), y = _mm_loadu_ps(xyzw + 4), z = _mm_loadu_ps(xyzw + 8), w = _mm_loadu_ps(xyzw + 12);
+            // rows were vertices, now x holds the x of all four and so on
+            _MM_TRANSPOSE4_PS(x, y, z, w);
+            __m128i packed = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(x, low), high), scale)), mask);
+            packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(y, low), high), scale)), mask), 10));
+            packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(z, low), high), scale)), mask), 20));
+            packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(w, low), high)), 30));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+        }
+#endif
+        for (; i < count; i++)
+        {
+            const float* value = in + i * components;
+            out[i] = toSnorm1010102(value[0], value[1], value[2], components > 3 ? value[3] : 0.0f);
+        }
+    }
+}
+
+// Describes how the attributes of one vertex are laid out in a buffer, so the layout is
+// written once instead of as hand counted offsets in every glVertexAttribPointer call.
+// Supported storage types and what the shader sees:
+//
+//     GL_FLOAT                         the float as is
+//     GL_HALF_FLOAT                    half precision float, half the size
+//     GL_UNSIGNED_BYTE (normalized)    0..255 mapped to 0..1, for colors
+//     GL_INT_2_10_10_10_REV            4 components in 32 bits, normalized to -1..1, for normals
+//
+// Every attribute starts on a 4 byte boundary as the hardware prefers, so a 3 component half
+// takes 8 bytes. pack converts float data into the layout.
+class VertexFormat
+{
+public:
+    struct Attribute
+    {
+        unsigned int location;
+        int components;
+        GLenum type;
+        bool normalized;
+        unsigned int offset;
+    };
+
+    // appends an attribute after the ones added before it
+    // ------------------------------------------------------------------------
+    VertexFormat& add(unsigned int location, int components, GLenum type, bool normalized = false)
+    {
+        if (type == GL_INT_2_10_10_10_REV)
+        {
+            // packed types are always 4 components in the GL, they just hold 3 or 4 values
+            components = 4;
+            normalized = true;
+        }
+        Attribute attribute = { location, components, type, normalized, size };
+        unsigned int bytes = type == GL_INT_2_10_10_10_REV ? 4 : components * typeSize(type);
+        size += (bytes + 3) & ~3u;
+        attributes.push_back(attribute);
+        return *this;
+    }
+
+    // bytes per vertex
+    unsigned int stride() const { return size; }
+
+    const std::vector<Attribute>& getAttributes() const { return attributes; }
+
+    // sets up the attributes of the bound VAO to read from the bound GL_ARRAY_BUFFER
+    // ------------------------------------------------------------------------
+    void apply(size_t bufferOffset = 0) const
+    {
+        for (const Attribute& attribute : attributes)
+        {
+            glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized ? GL_TRUE : GL_FALSE,
+                size, reinterpret_cast<void*>(bufferOffset + attribute.offset));
+            glEnableVertexAttribArray(attribute.location);
+        }
+    }
+
+    // converts count values of sourceComponents floats each into the attribute at location.
+    // vertices points at the first of count vertices of this format.
+    // sourceComponents defaults to the attribute's component count
+    // ------------------------------------------------------------------------
+    void pack(void* vertices, size_t count, unsigned int location, const float* source, int sourceComponents = 0) const
+    {
+        const Attribute* attribute = find(location);
+        if (!attribute)
+        {
+            std::cout << "ERROR::VERTEX_FORMAT::NO_ATTRIBUTE_AT_LOCATION: " << location << std::endl;
+            return;
+        }
+        int components = sourceComponents > 0 ? sourceComponents : attribute->components;
+        if (attribute->type != GL_INT_2_10_10_10_REV && components != attribute->components)
+        {
+            std::cout << "ERROR::VERTEX_FORMAT::COMPONENT_COUNT_MISMATCH: location " << location << std::endl;
+            return;
+        }
+
+        // convert a batch into a tight scratch array with the SIMD packers, then copy each
+        // vertex's part out to its place in the interleaved buffer
+        const size_t batch = 256;
+        unsigned int elementSize = attribute->type == GL_INT_2_10_10_10_REV ? 4 : attribute->components * typeSize(attribute->type);
+        std::vector<unsigned char> scratch(batch * elementSize);
+        unsigned char* destination = static_cast<unsigned char*>(vertices) + attribute->offset;
+        for (size_t first = 0; first < count; first += batch)
+        {
+            size_t n = std::min(batch, count - first);
+            const float* in = source + first * components;
+            switch (attribute->type)
+            {
+            case GL_HALF_FLOAT: vertex_packing::packHalf(in, reinterpret_cast<uint16_t*>(scratch.data()), n * components); break;
+            case GL_UNSIGNED_BYTE: vertex_packing::packUnorm8(in, scratch.data(), n * components); break;
+            case GL_INT_2_10_10_10_REV: vertex_packing::packSnorm1010102(in, components, reinterpret_cast<uint32_t*>(scratch.data()), n); break;
+            default: std::memcpy(scratch.data(), in, n * elementSize); break;
+            }
+            for (size_t i = 0; i < n; i++)
+                std::memcpy(destination + (first + i) * size, scratch.data() + i * elementSize, elementSize);
+        }
+    }
+
+private:
+    std::vector<Attribute> attributes;
+    unsigned int size = 0;
+
+    const Attribute* find(unsigned int location) const
+    {
+        for (const Attribute& attribute : attributes)
+            if (attribute.location == location)
+                return &attribute;
+        return nullptr;
+    }
+
+    static unsigned int typeSize(GLenum type)
+    {
+        switch (type)
+        {
+        case GL_HALF_FLOAT: return 2;
+        case GL_UNSIGNED_BYTE: return 1;
+        default: return 4;
+        }
+    }
+};
+
+#endif